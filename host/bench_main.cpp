@@ -0,0 +1,27 @@
+// Runs the control loop latency benchmarks (benchmark.cpp)
+// natively, with the inputs showing both trains in their
+// platforms and the points set for train A.
+
+#include "hal.h"
+#include "benchmark.h"
+#include "sketch.h"
+
+int main()
+{
+  HostSetDigitalInput(TRAIN_A_IN_PLATFORM_PIN, LOW);
+  HostSetDigitalInput(TRAIN_B_IN_PLATFORM_PIN, LOW);
+  HostSetDigitalInput(TRAIN_ON_LINE_PIN, HIGH);
+  HostSetDigitalInput(TRAIN_ON_SLOW_X_PIN, HIGH);
+  HostSetDigitalInput(TRAIN_ON_SLOW_Y_PIN, HIGH);
+  HostSetDigitalInput(POINT_X_PLAT_A_FEEDBACK_PIN, !INVERT_X_PLAT_A_POINT_FEEDBACK);
+  HostSetDigitalInput(POINT_X_PLAT_B_FEEDBACK_PIN, INVERT_X_PLAT_B_POINT_FEEDBACK);
+  HostSetDigitalInput(POINT_Y_PLAT_A_FEEDBACK_PIN, !INVERT_Y_PLAT_A_POINT_FEEDBACK);
+  HostSetDigitalInput(POINT_Y_PLAT_B_FEEDBACK_PIN, INVERT_Y_PLAT_B_POINT_FEEDBACK);
+
+  // The start up log is binary, keep it out of the results
+  Serial.setOutput(nullptr);
+  setup();
+  Serial.setOutput(stdout);
+  RunBenchmarks();
+  return 0;
+}
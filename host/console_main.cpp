@@ -0,0 +1,294 @@
+// Sends a command to the controller's serial console (see
+// console.h) and prints the records it replies with.
+//
+// Usage: train_console DEVICE COMMAND [ARGUMENTS]
+//   DEVICE is the Arduino's serial port, at 9600 baud, or the
+//   pseudo-terminal layout_sim pty=1 prints at start up.
+//   status              current, previous and next status
+//   snapshot            inputs, points feedback and track speeds
+//   stats               the statistics (see stats.h)
+//   get ITEM            a setting's value
+//   set ITEM VALUE      change and save a setting
+//   stop                stop everything until resumed
+//   resume              carry on from wherever the trains are
+//   log                 print the whole log until interrupted
+// ITEM is one of dwell, debounce, point_period, point_count, or
+// the polarities point_invert, feedback_invert, track_power,
+// forward and track_fast, which take effect from the next reset.
+//
+// Opening the port resets most Arduinos. For use while running,
+// disable the auto reset, e.g. with a 10uF capacitor from RESET
+// to GND.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "log_stream.h"
+
+// Give up on a reply after this long
+#define REPLY_TIMEOUT_MS 5000
+// The stats come a few records at a time, so
+// wait this long after the last before stopping
+#define STATS_QUIET_MS 1500
+
+struct NamedItem
+{
+  const char* name;
+  ConfigItem item;
+};
+
+static const NamedItem s_items[] = {
+  { "dwell",           ConfigItem::PlatformDwellTime   },
+  { "debounce",        ConfigItem::SensorDebounceDelay },
+  { "point_period",    ConfigItem::PointWaitPeriod     },
+  { "point_count",     ConfigItem::PointWaitCount      },
+  { "point_invert",    ConfigItem::PointControlInvert  },
+  { "feedback_invert", ConfigItem::FeedbackInvert      },
+  { "track_power",     ConfigItem::TrackPower          },
+  { "forward",         ConfigItem::Forward             },
+  { "track_fast",      ConfigItem::TrackFast           },
+};
+
+struct NamedCommand
+{
+  const char* name;
+  ConsoleCommand command;
+  // Arguments after the command name
+  int arguments;
+};
+
+static const NamedCommand s_commands[] = {
+  { "status",   ConsoleCommand::Status,   0 },
+  { "snapshot", ConsoleCommand::Snapshot, 0 },
+  { "stats",    ConsoleCommand::Stats,    0 },
+  { "get",      ConsoleCommand::Get,      1 },
+  { "set",      ConsoleCommand::Set,      2 },
+  { "stop",     ConsoleCommand::Stop,     0 },
+  { "resume",   ConsoleCommand::Resume,   0 },
+};
+
+static const char* const s_results[] = {
+  "ok", "unknown command", "bad argument", "bad frame"
+};
+
+static int Usage()
+{
+  fprintf(stderr, "Usage: train_console DEVICE status|snapshot|stats|stop|resume|log\n"
+                  "       train_console DEVICE get ITEM\n"
+                  "       train_console DEVICE set ITEM VALUE\n"
+                  "ITEM: dwell, debounce, point_period, point_count, point_invert,\n"
+                  "      feedback_invert, track_power, forward, track_fast\n");
+  return 1;
+}
+
+// Open the port raw, at 9600 baud if it's a real one
+static int OpenPort(const char* device)
+{
+  int port = open(device, O_RDWR | O_NOCTTY);
+  if (port < 0)
+  {
+    fprintf(stderr, "Can't open %s: %s\n", device, strerror(errno));
+    return -1;
+  }
+
+  termios settings;
+  if (tcgetattr(port, &settings) == 0)
+  {
+    cfmakeraw(&settings);
+    cfsetispeed(&settings, B9600);
+    cfsetospeed(&settings, B9600);
+    settings.c_cflag |= CLOCAL | CREAD;
+    settings.c_cflag &= ~HUPCL;
+    tcsetattr(port, TCSANOW, &settings);
+  }
+  return port;
+}
+
+static bool FindItem(const char* name, ConfigItem& item)
+{
+  for (const NamedItem& named : s_items)
+  {
+    if (strcmp(named.name, name) == 0)
+    {
+      item = named.item;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint64_t NowMillis()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Print every record until interrupted
+static int PrintLog(int port)
+{
+  LogReader reader;
+  uint8_t buffer[64];
+  ssize_t length;
+  while ((length = read(port, buffer, sizeof(buffer))) > 0)
+  {
+    for (ssize_t i = 0; i < length; ++i)
+    {
+      if (reader.Push(buffer[i]))
+      {
+        reader.Print(stdout);
+        fflush(stdout);
+      }
+    }
+  }
+  return 0;
+}
+
+// Print the replies to a command until its ConsoleAck (and
+// for stats, until they stop coming). The rest of the log
+// is skipped.
+static int PrintReplies(int port, ConsoleCommand command)
+{
+  LogReader reader;
+  uint64_t start = NowMillis();
+  uint64_t lastReply = start;
+  int result = -1;
+
+  while (true)
+  {
+    uint64_t now = NowMillis();
+    if (result >= 0 && (command != ConsoleCommand::Stats || now - lastReply >= STATS_QUIET_MS))
+    {
+      break;
+    }
+    if (result < 0 && now - start >= REPLY_TIMEOUT_MS)
+    {
+      fprintf(stderr, "No reply\n");
+      return 1;
+    }
+
+    pollfd ready = { port, POLLIN, 0 };
+    if (poll(&ready, 1, 100) <= 0)
+    {
+      continue;
+    }
+
+    uint8_t buffer[64];
+    ssize_t length = read(port, buffer, sizeof(buffer));
+    if (length <= 0)
+    {
+      fprintf(stderr, "Port closed\n");
+      return 1;
+    }
+
+    for (ssize_t i = 0; i < length; ++i)
+    {
+      if (!reader.Push(buffer[i]))
+      {
+        continue;
+      }
+
+      uint8_t id = reader.Id();
+      if (reader.Is(LogEventId::ConsoleAck))
+      {
+        if (reader.PayloadLength() >= 2 && reader.Payload()[0] == static_cast<uint8_t>(command))
+        {
+          result = reader.Payload()[1];
+          lastReply = NowMillis();
+        }
+      }
+      else if (id >= static_cast<uint8_t>(LogEventId::StatsState) &&
+               id <= static_cast<uint8_t>(LogEventId::ConsoleConfig))
+      {
+        reader.Print(stdout);
+        lastReply = NowMillis();
+      }
+    }
+  }
+
+  if (result != 0)
+  {
+    fprintf(stderr, "Failed: %s\n", result < 4 ? s_results[result] : "unknown result");
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    return Usage();
+  }
+
+  int port = OpenPort(argv[1]);
+  if (port < 0)
+  {
+    return 1;
+  }
+
+  if (strcmp(argv[2], "log") == 0)
+  {
+    return PrintLog(port);
+  }
+
+  const NamedCommand* named = nullptr;
+  for (const NamedCommand& candidate : s_commands)
+  {
+    if (strcmp(candidate.name, argv[2]) == 0)
+    {
+      named = &candidate;
+    }
+  }
+  if (!named || argc != 3 + named->arguments)
+  {
+    return Usage();
+  }
+
+  uint8_t command[6];
+  int length = 0;
+  command[length++] = static_cast<uint8_t>(named->command);
+
+  if (named->arguments > 0)
+  {
+    ConfigItem item;
+    if (!FindItem(argv[3], item))
+    {
+      return Usage();
+    }
+    command[length++] = static_cast<uint8_t>(item);
+  }
+
+  if (named->arguments > 1)
+  {
+    char* end;
+    unsigned long value = strtoul(argv[4], &end, 10);
+    if (*end != 0)
+    {
+      return Usage();
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+      command[length++] = static_cast<uint8_t>(value >> (8 * i));
+    }
+  }
+
+  // Lead with a 0, ending anything the controller had half read
+  uint8_t frame[sizeof(command) + 3];
+  frame[0] = 0;
+  int size = 1 + EncodeFrame(command, length, frame + 1);
+  if (write(port, frame, size) != size)
+  {
+    fprintf(stderr, "Can't write to %s\n", argv[1]);
+    return 1;
+  }
+
+  return PrintReplies(port, named->command);
+}
\ No newline at end of file
@@ -0,0 +1,295 @@
+#include "hal.h"
+
+#include <chrono>
+#include <string.h>
+#include <unistd.h>
+
+HostSerial Serial;
+
+static uint8_t s_pinModes[HOST_PIN_COUNT];
+static uint8_t s_inputLevels[HOST_PIN_COUNT];
+static uint8_t s_outputLevels[HOST_PIN_COUNT];
+static uint8_t s_pwmDuty[HOST_PIN_COUNT];
+static uint16_t s_analogLevels[HOST_PIN_COUNT];
+static bool s_inputDriven[HOST_PIN_COUNT];
+static bool s_pinChangeEnabled[HOST_PIN_COUNT];
+static void (*s_pinChangeHandler)() = nullptr;
+
+// Erased until the first access
+static uint8_t s_eeprom[HAL_EEPROM_SIZE];
+static bool s_eepromErased = false;
+
+// Time spent in HalDelay. Delays return immediately on the host
+// and the clock jumps forward instead, so start up and the error
+// display don't stall a profiling run.
+static uint64_t s_skippedMicros = 0;
+
+static bool s_virtualClock = false;
+static uint64_t s_virtualMicros = 0;
+
+static uint64_t ElapsedMicros()
+{
+  if (s_virtualClock)
+  {
+    return s_virtualMicros;
+  }
+
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() + s_skippedMicros;
+}
+
+void HalPinMode(uint8_t pin, uint8_t mode)
+{
+  if (pin >= HOST_PIN_COUNT) { return; }
+
+  s_pinModes[pin] = mode;
+
+  // Pulled up inputs read high until something drives them
+  if (mode == INPUT_PULLUP && !s_inputDriven[pin])
+  {
+    s_inputLevels[pin] = HIGH;
+  }
+}
+
+uint8_t HalDigitalRead(uint8_t pin)
+{
+  if (pin >= HOST_PIN_COUNT) { return LOW; }
+  return s_pinModes[pin] == OUTPUT ? s_outputLevels[pin] : s_inputLevels[pin];
+}
+
+void HalDigitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pin >= HOST_PIN_COUNT) { return; }
+  s_outputLevels[pin] = value ? HIGH : LOW;
+  s_pwmDuty[pin] = value ? 255 : 0;
+}
+
+void HalWritePort(uint8_t port, uint8_t mask, uint8_t levels)
+{
+  for (uint8_t bit = 0; bit < 8; ++bit)
+  {
+    if (mask & (1u << bit))
+    {
+      HalDigitalWrite(HalPortFirstPin(port) + bit, (levels >> bit) & 1);
+    }
+  }
+}
+
+// The level reads back as the one the pin spends most time at
+void HalPwmWrite(uint8_t pin, uint8_t duty)
+{
+  if (pin >= HOST_PIN_COUNT) { return; }
+  s_outputLevels[pin] = duty >= 128 ? HIGH : LOW;
+  s_pwmDuty[pin] = duty;
+}
+
+uint16_t HalAnalogRead(uint8_t pin)
+{
+  if (pin >= HOST_PIN_COUNT) { return 0; }
+  return s_analogLevels[pin];
+}
+
+uint32_t HalMillis()
+{
+  return static_cast<uint32_t>(ElapsedMicros() / 1000);
+}
+
+uint32_t HalMicros()
+{
+  return static_cast<uint32_t>(ElapsedMicros());
+}
+
+void HalEnablePinChange(uint8_t pin)
+{
+  if (pin >= HOST_PIN_COUNT) { return; }
+  s_pinChangeEnabled[pin] = true;
+}
+
+void HalDelay(uint32_t ms)
+{
+  if (s_virtualClock)
+  {
+    s_virtualMicros += static_cast<uint64_t>(ms) * 1000;
+    return;
+  }
+  s_skippedMicros += static_cast<uint64_t>(ms) * 1000;
+}
+
+static std::chrono::steady_clock::time_point s_counterStart;
+
+void HalResetCycleCounter()
+{
+  s_counterStart = std::chrono::steady_clock::now();
+}
+
+uint32_t HalReadCycleCounter()
+{
+  std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - s_counterStart;
+  return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+void HostUseVirtualClock(uint64_t startMicros)
+{
+  s_virtualClock = true;
+  s_virtualMicros = startMicros;
+}
+
+void HostSetMicros(uint64_t micros)
+{
+  if (micros > s_virtualMicros)
+  {
+    s_virtualMicros = micros;
+  }
+}
+
+uint64_t HostNowMicros()
+{
+  return ElapsedMicros();
+}
+
+void HostSetDigitalInput(uint8_t pin, uint8_t value)
+{
+  if (pin >= HOST_PIN_COUNT) { return; }
+  uint8_t level = value ? HIGH : LOW;
+  bool changed = s_inputLevels[pin] != level;
+  s_inputLevels[pin] = level;
+  s_inputDriven[pin] = true;
+
+  if (changed && s_pinChangeEnabled[pin] && s_pinChangeHandler)
+  {
+    s_pinChangeHandler();
+  }
+}
+
+void HostSetPinChangeHandler(void (*handler)())
+{
+  s_pinChangeHandler = handler;
+}
+
+void HostSetAnalogInput(uint8_t pin, uint16_t value)
+{
+  if (pin >= HOST_PIN_COUNT) { return; }
+  s_analogLevels[pin] = value;
+}
+
+uint8_t HostGetDigitalOutput(uint8_t pin)
+{
+  if (pin >= HOST_PIN_COUNT) { return LOW; }
+  return s_outputLevels[pin];
+}
+
+uint8_t HostGetPwmOutput(uint8_t pin)
+{
+  if (pin >= HOST_PIN_COUNT) { return 0; }
+  return s_pwmDuty[pin];
+}
+
+uint8_t HostGetPinMode(uint8_t pin)
+{
+  if (pin >= HOST_PIN_COUNT) { return INPUT; }
+  return s_pinModes[pin];
+}
+
+uint8_t* HostEeprom()
+{
+  if (!s_eepromErased)
+  {
+    memset(s_eeprom, 0xFF, sizeof(s_eeprom));
+    s_eepromErased = true;
+  }
+  return s_eeprom;
+}
+
+uint8_t HalEepromRead(uint16_t address)
+{
+  if (address >= HAL_EEPROM_SIZE) { return 0xFF; }
+  return HostEeprom()[address];
+}
+
+void HalEepromWrite(uint16_t address, uint8_t value)
+{
+  if (address >= HAL_EEPROM_SIZE) { return; }
+  HostEeprom()[address] = value;
+}
+
+bool HalEepromReady()
+{
+  return true;
+}
+
+void HostSerial::begin(unsigned long)
+{
+}
+
+void HostSerial::print(const char* text)
+{
+  if (m_output) { fputs(text, m_output); }
+}
+
+void HostSerial::print(const __FlashStringHelper* text)
+{
+  print(reinterpret_cast<const char*>(text));
+}
+
+void HostSerial::print(char value)
+{
+  if (m_output) { fputc(value, m_output); }
+}
+
+void HostSerial::print(int value)
+{
+  if (m_output) { fprintf(m_output, "%d", value); }
+}
+
+void HostSerial::print(unsigned int value)
+{
+  if (m_output) { fprintf(m_output, "%u", value); }
+}
+
+void HostSerial::print(long value)
+{
+  if (m_output) { fprintf(m_output, "%ld", value); }
+}
+
+void HostSerial::print(unsigned long value)
+{
+  if (m_output) { fprintf(m_output, "%lu", value); }
+}
+
+void HostSerial::println()
+{
+  if (m_output) { fputc('\n', m_output); }
+}
+
+size_t HostSerial::write(uint8_t value)
+{
+  if (m_output) { fputc(value, m_output); }
+  if (m_port >= 0)
+  {
+    // Dropped if the port is full, as nobody is reading it
+    ssize_t written = ::write(m_port, &value, 1);
+    (void)written;
+  }
+  return 1;
+}
+
+int HostSerial::available()
+{
+  if (m_inputPosition == m_inputLength && m_port >= 0)
+  {
+    ssize_t length = ::read(m_port, m_input, sizeof(m_input));
+    m_inputLength = length > 0 ? static_cast<int>(length) : 0;
+    m_inputPosition = 0;
+  }
+  return m_inputLength - m_inputPosition;
+}
+
+int HostSerial::read()
+{
+  if (available() == 0)
+  {
+    return -1;
+  }
+  return m_input[m_inputPosition++];
+}
\ No newline at end of file
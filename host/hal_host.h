@@ -0,0 +1,113 @@
+#pragma once
+
+// Host (Linux) side of the hardware abstraction layer. Provides
+// the Arduino names the sketch relies on (pin names, pin modes,
+// Serial) and a set of Host* calls to drive the inputs and read
+// back the outputs in place of real hardware.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HIGH 1
+#define LOW  0
+
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+// Pin numbering of the Arduino Nano the sketch targets
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+
+#define HOST_PIN_COUNT 22
+
+// Program memory is ordinary memory on the host
+#define PROGMEM
+#define pgm_read_byte(address) (*reinterpret_cast<const uint8_t*>(address))
+#define pgm_read_word(address) (*reinterpret_cast<const uint16_t*>(address))
+#define pgm_read_ptr(address) (*reinterpret_cast<void* const*>(address))
+
+// Flash strings are ordinary strings on the host
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+// Stand in for the Arduino Serial, writing text to a
+// file (stdout by default, nullptr to discard it). It can also be
+// given a port, such as a pseudo-terminal, which writes go out
+// on as well and reads come in from.
+class HostSerial
+{
+public:
+  void begin(unsigned long baud);
+
+  void print(const char* text);
+  void print(const __FlashStringHelper* text);
+  void print(char value);
+  void print(int value);
+  void print(unsigned int value);
+  void print(long value);
+  void print(unsigned long value);
+
+  void println();
+  template <typename T> void println(T value) { print(value); println(); }
+
+  size_t write(uint8_t value);
+  // Writes go straight out on the host, so there is always
+  // as much room as the Arduino's TX buffer would have
+  int availableForWrite() { return 63; }
+
+  // Bytes which have come in on the port and not been read
+  int available();
+  // The next byte in, or -1 if there isn't one
+  int read();
+
+  void setOutput(FILE* output) { m_output = output; }
+  // A non-blocking file descriptor, or -1 for none. Writes which
+  // would block are dropped, as if the line had lost them.
+  void setPort(int port) { m_port = port; }
+
+private:
+  FILE* m_output = stdout;
+  int m_port = -1;
+  uint8_t m_input[64];
+  int m_inputLength = 0;
+  int m_inputPosition = 0;
+};
+
+extern HostSerial Serial;
+
+// Set the level seen on an input pin. If the level changes and
+// HalEnablePinChange has been called for the pin, the pin change
+// handler runs before this returns, as the interrupt would.
+void HostSetDigitalInput(uint8_t pin, uint8_t value);
+// Function to call for pin changes, standing in for the
+// PCINTn_vect interrupt handlers
+void HostSetPinChangeHandler(void (*handler)());
+// Set the value returned by HalAnalogRead for a pin (0-1023)
+void HostSetAnalogInput(uint8_t pin, uint16_t value);
+// Read back the level last written to an output pin
+uint8_t HostGetDigitalOutput(uint8_t pin);
+// Read back the PWM duty (out of 255) last written to an output
+// pin; a digital write reads back as 0 or 255
+uint8_t HostGetPwmOutput(uint8_t pin);
+// Mode last set for a pin
+uint8_t HostGetPinMode(uint8_t pin);
+
+// The EEPROM contents, so a host program can inspect them or
+// keep them over a restart. Starts erased (all 0xFF).
+uint8_t* HostEeprom();
+
+// Switch the HAL clock from real time to a virtual clock, which
+// only moves when told to (or when the controller calls HalDelay).
+// Lets a simulation run far faster than real time.
+void HostUseVirtualClock(uint64_t startMicros = 0);
+// Move the virtual clock forward to an absolute time
+void HostSetMicros(uint64_t micros);
+// Current time in microseconds, without wrapping at 32 bits
+uint64_t HostNowMicros();
@@ -0,0 +1,536 @@
+#include "layout_sim.h"
+
+#include <stdio.h>
+
+#include "hal.h"
+#include "defines.h"
+
+static const int TRAIN_A = 0;
+static const int TRAIN_B = 1;
+static const int POINTS_X = 0;
+static const int POINTS_Y = 1;
+static const int SECTIONS_PER_LOOP = 4;
+static const uint64_t BOUNCE_STEP_MICROS = 3000;
+
+// Order in which each train passes through the sections
+static const Section s_trainPaths[2][SECTIONS_PER_LOOP] = {
+  { Section::PlatformA, Section::SlowX, Section::FastLine, Section::SlowY },
+  { Section::PlatformB, Section::SlowY, Section::FastLine, Section::SlowX }
+};
+
+static const char* s_trainNames[2] = { "A", "B" };
+
+// Divide rounding towards negative infinity
+static int64_t FloorDiv(int64_t value, int64_t divisor)
+{
+  int64_t result = value / divisor;
+  return (value % divisor != 0 && value < 0) ? result - 1 : result;
+}
+
+// Wrap a position onto [0, length)
+static int64_t Wrap(int64_t position, int64_t length)
+{
+  return position - FloorDiv(position, length) * length;
+}
+
+// True if moving from "from" to "to" passes over
+// boundary + k * length for any k.
+static bool Crosses(int64_t from, int64_t to, int64_t boundary, int64_t length)
+{
+  if (to > from)
+  {
+    return FloorDiv(to - boundary, length) > FloorDiv(from - boundary, length);
+  }
+  return FloorDiv(from - 1 - boundary, length) > FloorDiv(to - 1 - boundary, length);
+}
+
+LayoutConfig DefaultLayoutConfig()
+{
+  LayoutConfig config;
+  config.platformLength = 1000;
+  config.slowXLength = 1500;
+  config.fastLineLength = 6000;
+  config.slowYLength = 1500;
+  config.irSensorPosition = 800;
+  config.detectorHoldMs = 100;
+  config.dropoutMs = 0;
+  config.dropoutPeriodMs = 5000;
+  config.xThrowMs = 1500;
+  config.yThrowMs = 1500;
+  config.bounceMs = 0;
+  config.dwellInput = 512;
+  config.trains[TRAIN_A].fastSpeed = 300;
+  config.trains[TRAIN_A].slowSpeed = 100;
+  config.trains[TRAIN_A].length = 300;
+  config.trains[TRAIN_B].fastSpeed = 300;
+  config.trains[TRAIN_B].slowSpeed = 100;
+  config.trains[TRAIN_B].length = 300;
+  return config;
+}
+
+LayoutSim::LayoutSim(const LayoutConfig& config)
+  : m_config(config),
+    m_power(false),
+    m_duty(0),
+    m_forward(true),
+    m_fast(false),
+    m_now(0),
+    m_faults(0)
+{
+  // Both trains start standing in their platforms, with
+  // their fronts just past the IR sensor.
+  for (int train = 0; train < 2; ++train)
+  {
+    m_trains[train].position = (static_cast<int64_t>(m_config.irSensorPosition) + 10) * 1000;
+    m_trains[train].velocity = 0;
+    m_trains[train].laps = 0;
+  }
+
+  for (int points = 0; points < 2; ++points)
+  {
+    m_points[points].position = PointsDirection::ForTrainA;
+    m_points[points].commanded = PointsDirection::ForTrainA;
+    m_points[points].arrivalMicros = 0;
+  }
+
+  for (int section = 0; section < static_cast<int>(Section::Count); ++section)
+  {
+    m_detectors[section].occupied = false;
+    m_detectors[section].releaseMicros = 0;
+  }
+
+  UpdateDetectors();
+}
+
+int64_t LayoutSim::LoopLength() const
+{
+  return (static_cast<int64_t>(m_config.platformLength) + m_config.slowXLength +
+          m_config.fastLineLength + m_config.slowYLength) * 1000;
+}
+
+Section LayoutSim::SectionAt(int train, int index) const
+{
+  return s_trainPaths[train][index];
+}
+
+int64_t LayoutSim::SectionStart(int train, int index) const
+{
+  int64_t start = 0;
+  for (int i = 0; i < index; ++i)
+  {
+    switch (SectionAt(train, i))
+    {
+      case Section::PlatformA:
+      case Section::PlatformB: start += m_config.platformLength; break;
+      case Section::SlowX:     start += m_config.slowXLength; break;
+      case Section::FastLine:  start += m_config.fastLineLength; break;
+      case Section::SlowY:     start += m_config.slowYLength; break;
+      default: break;
+    }
+  }
+  return start * 1000;
+}
+
+// True if any part of the train lies within [start, end)
+// of its loop, allowing for the loop wrapping round.
+bool LayoutSim::Overlaps(int train, int64_t start, int64_t end) const
+{
+  int64_t length = LoopLength();
+  int64_t front = m_trains[train].position;
+  int64_t tail = front - static_cast<int64_t>(m_config.trains[train].length) * 1000;
+
+  for (int shift = -1; shift <= 1; ++shift)
+  {
+    if (tail + shift * length < end && front + shift * length > start)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LayoutSim::TrainInSection(int train, Section section) const
+{
+  for (int index = 0; index < SECTIONS_PER_LOOP; ++index)
+  {
+    if (SectionAt(train, index) == section)
+    {
+      return Overlaps(train, SectionStart(train, index), SectionStart(train, index + 1));
+    }
+  }
+  return false;
+}
+
+// A train picks up power anywhere on the main line, but in its
+// platform only when the points connect the platform to the line.
+bool LayoutSim::Powered(int train) const
+{
+  if (!m_power)
+  {
+    return false;
+  }
+
+  if (TrainInSection(train, Section::SlowX) ||
+      TrainInSection(train, Section::FastLine) ||
+      TrainInSection(train, Section::SlowY))
+  {
+    return true;
+  }
+
+  if (train == TRAIN_A)
+  {
+    return m_points[POINTS_Y].position == PointsDirection::ForTrainA;
+  }
+  return m_points[POINTS_X].position == PointsDirection::ForTrainB;
+}
+
+bool LayoutSim::IrActive(int train) const
+{
+  int64_t sensor = static_cast<int64_t>(m_config.irSensorPosition) * 1000;
+  return Overlaps(train, sensor, sensor + 1);
+}
+
+bool LayoutSim::DetectorRaw(Section section) const
+{
+  switch (section)
+  {
+    case Section::SlowX:
+      return TrainInSection(TRAIN_A, Section::SlowX) ||
+             TrainInSection(TRAIN_B, Section::SlowX) ||
+             (TrainInSection(TRAIN_B, Section::PlatformB) &&
+              m_points[POINTS_X].position == PointsDirection::ForTrainB);
+    case Section::SlowY:
+      return TrainInSection(TRAIN_A, Section::SlowY) ||
+             TrainInSection(TRAIN_B, Section::SlowY) ||
+             (TrainInSection(TRAIN_A, Section::PlatformA) &&
+              m_points[POINTS_Y].position == PointsDirection::ForTrainA);
+    case Section::FastLine:
+      return TrainInSection(TRAIN_A, Section::FastLine) ||
+             TrainInSection(TRAIN_B, Section::FastLine);
+    default:
+      return false;
+  }
+}
+
+// Microseconds into the current dropout period
+static uint64_t DropoutPhase(const LayoutConfig& config, Section section, uint64_t now)
+{
+  uint64_t period = static_cast<uint64_t>(config.dropoutPeriodMs) * 1000;
+  uint64_t offset = period * static_cast<int>(section) / static_cast<int>(Section::Count);
+  return (now + offset) % period;
+}
+
+bool LayoutSim::InDropout(Section section) const
+{
+  if (m_config.dropoutMs == 0 || m_config.dropoutPeriodMs == 0)
+  {
+    return false;
+  }
+  return DropoutPhase(m_config, section, m_now) < static_cast<uint64_t>(m_config.dropoutMs) * 1000;
+}
+
+// When the section's detector next starts or stops dropping out
+uint64_t LayoutSim::NextDropoutChange(Section section) const
+{
+  if (m_config.dropoutMs == 0 || m_config.dropoutPeriodMs == 0)
+  {
+    return UINT64_MAX;
+  }
+
+  uint64_t phase = DropoutPhase(m_config, section, m_now);
+  uint64_t dropout = static_cast<uint64_t>(m_config.dropoutMs) * 1000;
+  uint64_t period = static_cast<uint64_t>(m_config.dropoutPeriodMs) * 1000;
+  return m_now + (phase < dropout ? dropout - phase : period - phase);
+}
+
+bool LayoutSim::DetectorActive(Section section) const
+{
+  const SimDetector& detector = m_detectors[static_cast<int>(section)];
+  if (detector.occupied)
+  {
+    return !InDropout(section);
+  }
+  return m_now < detector.releaseMicros;
+}
+
+void LayoutSim::UpdateDetectors()
+{
+  for (int section = 0; section < static_cast<int>(Section::Count); ++section)
+  {
+    SimDetector& detector = m_detectors[section];
+    bool occupied = DetectorRaw(static_cast<Section>(section));
+
+    // Either still occupied, or it has just been vacated
+    if (occupied || detector.occupied)
+    {
+      detector.releaseMicros = m_now + static_cast<uint64_t>(m_config.detectorHoldMs) * 1000;
+    }
+    detector.occupied = occupied;
+  }
+}
+
+void LayoutSim::UpdateVelocities()
+{
+  for (int train = 0; train < 2; ++train)
+  {
+    if (!Powered(train))
+    {
+      m_trains[train].velocity = 0;
+      continue;
+    }
+
+    const TrainConfig& config = m_config.trains[train];
+    int32_t speed = (m_fast ? config.fastSpeed : config.slowSpeed) * m_duty / TRACK_SPEED_MAX;
+    bool trainForward = (train == TRAIN_A) == m_forward;
+    m_trains[train].velocity = trainForward ? speed : -speed;
+  }
+}
+
+void LayoutSim::ReadOutputs(uint64_t nowMicros)
+{
+  AdvanceTo(nowMicros);
+
+  uint8_t duty = HostGetPwmOutput(TRACK_POWER_PIN);
+  m_duty = TRACK_POWER ? duty : TRACK_SPEED_MAX - duty;
+  m_power = m_duty > 0;
+  m_forward = HostGetDigitalOutput(TRACK_DIRECTION_PIN) == FORWARD;
+  m_fast = HostGetDigitalOutput(TRACK_FAST_PIN) == TRACK_FAST;
+
+  const uint8_t controlPins[2] = { POINT_X_CONTROL_PIN, POINT_Y_CONTROL_PIN };
+  const bool invertControl[2] = { INVERT_X_POINT_CONTROL, INVERT_Y_POINT_CONTROL };
+  const uint32_t throwMs[2] = { m_config.xThrowMs, m_config.yThrowMs };
+
+  for (int points = 0; points < 2; ++points)
+  {
+    bool forTrainB = HostGetDigitalOutput(controlPins[points]) ^ invertControl[points];
+    PointsDirection commanded = forTrainB ? PointsDirection::ForTrainB : PointsDirection::ForTrainA;
+
+    SimPoints& sim = m_points[points];
+    bool moving = sim.position == PointsDirection::Invalid;
+    if (commanded == sim.commanded && (moving || sim.position == commanded))
+    {
+      continue;
+    }
+
+    sim.commanded = commanded;
+    sim.position = PointsDirection::Invalid;
+    sim.arrivalMicros = m_now + static_cast<uint64_t>(throwMs[points]) * 1000;
+  }
+
+  UpdateDetectors();
+  UpdateVelocities();
+}
+
+uint64_t LayoutSim::NextEventMicros() const
+{
+  uint64_t next = UINT64_MAX;
+
+  for (int points = 0; points < 2; ++points)
+  {
+    const SimPoints& sim = m_points[points];
+    if (sim.position == PointsDirection::Invalid && sim.arrivalMicros < next)
+    {
+      next = sim.arrivalMicros;
+    }
+
+    // Each change of the feedback while it bounces
+    uint64_t bounceEnd = sim.arrivalMicros + static_cast<uint64_t>(m_config.bounceMs) * 1000;
+    if (sim.position != PointsDirection::Invalid && m_now < bounceEnd)
+    {
+      uint64_t change = sim.arrivalMicros +
+                        ((m_now - sim.arrivalMicros) / BOUNCE_STEP_MICROS + 1) * BOUNCE_STEP_MICROS;
+      if (change > bounceEnd)
+      {
+        change = bounceEnd;
+      }
+      if (change < next)
+      {
+        next = change;
+      }
+    }
+  }
+
+  for (int section = 0; section < static_cast<int>(Section::Count); ++section)
+  {
+    const SimDetector& detector = m_detectors[section];
+    if (!detector.occupied && detector.releaseMicros > m_now && detector.releaseMicros < next)
+    {
+      next = detector.releaseMicros;
+    }
+
+    uint64_t dropout = NextDropoutChange(static_cast<Section>(section));
+    if (detector.occupied && dropout < next)
+    {
+      next = dropout;
+    }
+  }
+
+  // The next time either end of a moving train passes
+  // a section boundary or the IR sensor.
+  int64_t length = LoopLength();
+  for (int train = 0; train < 2; ++train)
+  {
+    int32_t velocity = m_trains[train].velocity;
+    if (velocity == 0)
+    {
+      continue;
+    }
+
+    int64_t ends[2] = {
+      m_trains[train].position,
+      m_trains[train].position - static_cast<int64_t>(m_config.trains[train].length) * 1000
+    };
+
+    for (int end = 0; end < 2; ++end)
+    {
+      for (int marker = 0; marker <= SECTIONS_PER_LOOP; ++marker)
+      {
+        int64_t position = marker < SECTIONS_PER_LOOP ?
+                           SectionStart(train, marker) :
+                           static_cast<int64_t>(m_config.irSensorPosition) * 1000;
+
+        // Aim one micrometre past the marker so the crossing
+        // has definitely happened when the event fires.
+        int64_t distance = velocity > 0 ?
+                           Wrap(position + 1 - ends[end], length) :
+                           Wrap(ends[end] - (position - 1), length);
+        if (distance == 0)
+        {
+          distance = length;
+        }
+
+        uint32_t speed = velocity > 0 ? velocity : -velocity;
+        uint64_t micros = m_now + (static_cast<uint64_t>(distance) * 1000 + speed - 1) / speed;
+        if (micros < next)
+        {
+          next = micros;
+        }
+      }
+    }
+  }
+
+  return next;
+}
+
+void LayoutSim::Fault(const char* what, int train)
+{
+  ++m_faults;
+  fprintf(stderr, "[%10.3f s] Train %s: %s\n", m_now / 1e6, s_trainNames[train], what);
+}
+
+// Check the points under a train as either end of it passes
+// over them, and count laps as the front re-enters the platform.
+void LayoutSim::CheckCrossing(int train, int64_t from, int64_t to)
+{
+  int64_t length = LoopLength();
+  int64_t trainLength = static_cast<int64_t>(m_config.trains[train].length) * 1000;
+  // Leaving the platform and arriving back into it
+  int64_t exitJunction = SectionStart(train, 1);
+  int64_t entryJunction = 0;
+  int exitPoints = train == TRAIN_A ? POINTS_X : POINTS_Y;
+  int entryPoints = train == TRAIN_A ? POINTS_Y : POINTS_X;
+  PointsDirection needed = train == TRAIN_A ? PointsDirection::ForTrainA : PointsDirection::ForTrainB;
+
+  const int64_t offsets[2] = { 0, trainLength };
+  for (int end = 0; end < 2; ++end)
+  {
+    int64_t offset = offsets[end];
+    if (Crosses(from - offset, to - offset, exitJunction, length) &&
+        m_points[exitPoints].position != needed)
+    {
+      Fault(exitPoints == POINTS_X ? "ran through points X" : "ran through points Y", train);
+    }
+
+    if (Crosses(from - offset, to - offset, entryJunction, length) &&
+        m_points[entryPoints].position != needed)
+    {
+      Fault(entryPoints == POINTS_X ? "ran through points X" : "ran through points Y", train);
+    }
+  }
+
+  if (to > from && Crosses(from, to, entryJunction, length))
+  {
+    ++m_trains[train].laps;
+  }
+}
+
+void LayoutSim::MoveTrains(uint64_t micros)
+{
+  uint64_t elapsed = micros - m_now;
+  int64_t length = LoopLength();
+
+  for (int train = 0; train < 2; ++train)
+  {
+    SimTrain& sim = m_trains[train];
+    if (sim.velocity == 0)
+    {
+      continue;
+    }
+
+    int64_t from = sim.position;
+    int64_t to = from + static_cast<int64_t>(sim.velocity) * static_cast<int64_t>(elapsed) / 1000;
+    CheckCrossing(train, from, to);
+    sim.position = Wrap(to, length);
+  }
+}
+
+void LayoutSim::AdvanceTo(uint64_t micros)
+{
+  while (m_now < micros)
+  {
+    uint64_t next = NextEventMicros();
+    if (next > micros)
+    {
+      next = micros;
+    }
+
+    MoveTrains(next);
+    m_now = next;
+
+    for (int points = 0; points < 2; ++points)
+    {
+      SimPoints& sim = m_points[points];
+      if (sim.position == PointsDirection::Invalid && sim.arrivalMicros <= m_now)
+      {
+        sim.position = sim.commanded;
+      }
+    }
+
+    // Trains coming off their platform onto the main line (or
+    // the points moving) can change which trains have power.
+    UpdateDetectors();
+    UpdateVelocities();
+  }
+}
+
+// Which way the feedback contacts of a set of points read
+PointsDirection LayoutSim::Feedback(int points) const
+{
+  const SimPoints& sim = m_points[points];
+  uint64_t bounceEnd = sim.arrivalMicros + static_cast<uint64_t>(m_config.bounceMs) * 1000;
+  if (sim.position != PointsDirection::Invalid && m_now < bounceEnd &&
+      (m_now - sim.arrivalMicros) / BOUNCE_STEP_MICROS % 2 == 0)
+  {
+    return PointsDirection::Invalid;
+  }
+  return sim.position;
+}
+
+void LayoutSim::WriteInputs() const
+{
+  // Track sensors are active low
+  HostSetDigitalInput(TRAIN_A_IN_PLATFORM_PIN, !IrActive(TRAIN_A));
+  HostSetDigitalInput(TRAIN_B_IN_PLATFORM_PIN, !IrActive(TRAIN_B));
+  HostSetDigitalInput(TRAIN_ON_LINE_PIN, !DetectorActive(Section::FastLine));
+  HostSetDigitalInput(TRAIN_ON_SLOW_X_PIN, !DetectorActive(Section::SlowX));
+  HostSetDigitalInput(TRAIN_ON_SLOW_Y_PIN, !DetectorActive(Section::SlowY));
+
+  PointsDirection x = Feedback(POINTS_X);
+  PointsDirection y = Feedback(POINTS_Y);
+  HostSetDigitalInput(POINT_X_PLAT_A_FEEDBACK_PIN, (x == PointsDirection::ForTrainA) ^ INVERT_X_PLAT_A_POINT_FEEDBACK);
+  HostSetDigitalInput(POINT_X_PLAT_B_FEEDBACK_PIN, (x == PointsDirection::ForTrainB) ^ INVERT_X_PLAT_B_POINT_FEEDBACK);
+  HostSetDigitalInput(POINT_Y_PLAT_A_FEEDBACK_PIN, (y == PointsDirection::ForTrainA) ^ INVERT_Y_PLAT_A_POINT_FEEDBACK);
+  HostSetDigitalInput(POINT_Y_PLAT_B_FEEDBACK_PIN, (y == PointsDirection::ForTrainB) ^ INVERT_Y_PLAT_B_POINT_FEEDBACK);
+
+  HostSetAnalogInput(PLATFORM_DWELL_TIME_PIN, m_config.dwellInput);
+}
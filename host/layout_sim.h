@@ -0,0 +1,144 @@
+#pragma once
+
+// Discrete event model of the layout in the readme, used to drive
+// the controller's inputs from its outputs on a virtual clock.
+//
+// Each train runs round its own loop of sections, starting at the
+// beginning of its platform:
+//   Train A: PlatformA -(X)- SlowX - FastLine - SlowY -(Y)- PlatformA
+//   Train B: PlatformB -(Y)- SlowY - FastLine - SlowX -(X)- PlatformB
+// Positions are in micrometres along that loop, measured to the
+// front of the train. Train A moves forward when the track direction
+// is FORWARD, train B when it is reversed.
+//
+// Platform A is electrically part of Slow Y when points Y are set for
+// train A, and platform B part of Slow X when points X are set for
+// train B (see the readme). Otherwise the platforms are isolated, so
+// the train standing there neither moves nor shows on a detector.
+
+#include <stdint.h>
+
+#include "enums.h"
+
+enum class Section
+{
+  PlatformA,
+  PlatformB,
+  SlowX,
+  FastLine,
+  SlowY,
+  Count
+};
+
+// Speeds are at full track power, with the fast output on and off.
+// Trains run at the fraction of those given by the PWM duty.
+struct TrainConfig
+{
+  uint32_t fastSpeed;   // mm/s
+  uint32_t slowSpeed;   // mm/s
+  uint32_t length;      // mm
+};
+
+struct LayoutConfig
+{
+  uint32_t platformLength;    // mm
+  uint32_t slowXLength;       // mm
+  uint32_t fastLineLength;    // mm
+  uint32_t slowYLength;       // mm
+  // Distance of the IR sensor from the start of each platform
+  uint32_t irSensorPosition;  // mm
+  // How long the current detectors stay active after the train
+  // has left their section, giving the overlap the controller
+  // relies on.
+  uint32_t detectorHoldMs;
+  // Dirty track: while occupied each current detector drops out
+  // for dropoutMs every dropoutPeriodMs (0 for never). The
+  // detectors take turns, so they don't all drop out at once.
+  uint32_t dropoutMs;
+  uint32_t dropoutPeriodMs;
+  uint32_t xThrowMs;
+  uint32_t yThrowMs;
+  // The point feedback contacts bounce for this long once the
+  // points arrive, reading neither way every other 3ms.
+  uint32_t bounceMs;
+  // Value read from the dwell time potentiometer (0-1023)
+  uint16_t dwellInput;
+  TrainConfig trains[2];
+};
+
+LayoutConfig DefaultLayoutConfig();
+
+struct SimTrain
+{
+  int64_t position;         // um, front of the train along its loop
+  int32_t velocity;         // mm/s, signed along its loop
+  uint32_t laps;            // completed trips round the loop
+};
+
+struct SimPoints
+{
+  PointsDirection position; // Invalid while moving
+  PointsDirection commanded;
+  uint64_t arrivalMicros;
+};
+
+struct SimDetector
+{
+  bool occupied;
+  // Stays active until then once the section is vacated
+  uint64_t releaseMicros;
+};
+
+class LayoutSim
+{
+public:
+  explicit LayoutSim(const LayoutConfig& config);
+
+  // Latch the controller outputs (track power, direction,
+  // speed and point controls) at the given time.
+  void ReadOutputs(uint64_t nowMicros);
+  // Move the model forward, stopping at every event on the way
+  void AdvanceTo(uint64_t micros);
+  // Time of the next change in the model if the outputs stay as
+  // they are, or UINT64_MAX if nothing is going to happen.
+  uint64_t NextEventMicros() const;
+  // Present the model's state on the controller's input pins
+  void WriteInputs() const;
+
+  const SimTrain& Train(int train) const { return m_trains[train]; }
+  // Number of times the model caught the controller doing
+  // something which would derail or crash a train.
+  uint32_t Faults() const { return m_faults; }
+  uint64_t NowMicros() const { return m_now; }
+
+private:
+  int64_t LoopLength() const;
+  int64_t SectionStart(int train, int index) const;
+  Section SectionAt(int train, int index) const;
+  bool Overlaps(int train, int64_t start, int64_t end) const;
+  bool TrainInSection(int train, Section section) const;
+  bool Powered(int train) const;
+  bool IrActive(int train) const;
+  bool DetectorRaw(Section section) const;
+  bool DetectorActive(Section section) const;
+  bool InDropout(Section section) const;
+  PointsDirection Feedback(int points) const;
+  uint64_t NextDropoutChange(Section section) const;
+  void UpdateVelocities();
+  void UpdateDetectors();
+  void MoveTrains(uint64_t micros);
+  void CheckCrossing(int train, int64_t from, int64_t to);
+  void Fault(const char* what, int train);
+
+  LayoutConfig m_config;
+  SimTrain m_trains[2];
+  SimPoints m_points[2];   // X, Y
+  SimDetector m_detectors[static_cast<int>(Section::Count)];
+  bool m_power;
+  // Fraction of full power, out of TRACK_SPEED_MAX
+  uint32_t m_duty;
+  bool m_forward;
+  bool m_fast;
+  uint64_t m_now;
+  uint32_t m_faults;
+};
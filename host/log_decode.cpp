@@ -0,0 +1,40 @@
+// Turns the controller's binary log (see telemetry.h) back into
+// text, one line per record with the time since boot.
+//
+// Usage: log_decode [file]
+//   Reads the raw serial stream from the file, or stdin if none.
+//   e.g. log_decode < /dev/ttyUSB0, or layout_sim log=run.bin
+
+#include <stdio.h>
+
+#include "log_stream.h"
+
+int main(int argc, char** argv)
+{
+  FILE* input = stdin;
+  if (argc > 1)
+  {
+    input = fopen(argv[1], "rb");
+    if (!input)
+    {
+      fprintf(stderr, "Can't open %s\n", argv[1]);
+      return 1;
+    }
+  }
+
+  LogReader reader;
+  int c;
+  while ((c = fgetc(input)) != EOF)
+  {
+    if (reader.Push(static_cast<uint8_t>(c)))
+    {
+      reader.Print(stdout);
+    }
+  }
+
+  if (reader.Corrupt())
+  {
+    fprintf(stderr, "%u corrupt frames skipped\n", reader.Corrupt());
+  }
+  return 0;
+}
\ No newline at end of file
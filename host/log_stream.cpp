@@ -0,0 +1,203 @@
+#include "log_stream.h"
+
+#include "point_control.h"
+#include "state_control.h"
+#include "telemetry.h"
+
+// How to print each payload field:
+//   s TrainStatus, d PointsDirection, c character,
+//   b uint8, w uint16, i int16, l uint32
+struct EventFormat
+{
+  const char* name;
+  const char* fields;
+};
+
+static const EventFormat s_formats[] = {
+  { "Boot",                  "b"    },
+  { "Dropped",               "w"    },
+  { "StateChange",           "ss"   },
+  { "TransitionFailed",      "ss"   },
+  { "ErrorCode",             "b"    },
+  { "DwellTime",             "wl"   },
+  { "TrackPower",            "bi"   },
+  { "TrackPowerInvalid",     "b"    },
+  { "PointsThrow",           "cdd"  },
+  { "PointsConfirmed",       "c"    },
+  { "PointsFailed",          "c"    },
+  { "PointsFeedbackInvalid", "cb"   },
+  { "PointsRecoveryStart",   "c"    },
+  { "PointsRecoveryWiggle",  "c"    },
+  { "PointsRecoveryFailed",  "c"    },
+  { "PointsRecovered",       "c"    },
+  { "TaskStats",             "bwww" },
+  { "BlockReserved",         "bb"   },
+  { "BlockReleased",         "bb"   },
+  { "TrainHeld",             "bb"   },
+  { "TrainResumed",          "bb"   },
+  { "TransitTime",           "bbbw" },
+  { "BrakePlanned",          "bbw"  },
+  { "CalibrationDone",       ""     },
+  { "SensorHoldOff",         "bw"   },
+  { "PointsFeedbackNoise",   "cw"   },
+  { "SensorsReady",          "wb"   },
+  { "JournalRestored",       "ssb"  },
+  { "StatsState",            "swl"  },
+  { "StatsResidency",        "sbw"  },
+  { "StatsPointsLatency",    "bbw"  },
+  { "StatsRoundTrips",       "bw"   },
+  { "ConsoleAck",            "bb"   },
+  { "ConsoleStatus",         "sss"  },
+  { "ConsoleSnapshot",       "wdd"  },
+  { "ConsoleSpeed",          "bii"  },
+  { "ConsoleConfig",         "bl"   },
+  { "ConfigLoaded",          "b"    },
+  { "InputEventsOverflowed", "w"    },
+};
+
+static const int EVENT_COUNT = sizeof(s_formats) / sizeof(s_formats[0]);
+static_assert(EVENT_COUNT == static_cast<int>(LogEventId::InputEventsOverflowed) + 1,
+              "Every LogEventId needs a format");
+
+// Undo the COBS framing in place, returning the decoded
+// length or -1 if the frame is corrupt.
+static int DecodeFrame(uint8_t* frame, int length)
+{
+  int in = 0;
+  int out = 0;
+  while (in < length)
+  {
+    int code = frame[in++];
+    if (code == 0 || in + code - 1 > length)
+    {
+      return -1;
+    }
+    for (int i = 1; i < code; ++i)
+    {
+      frame[out++] = frame[in++];
+    }
+    if (code < 0xFF && in < length)
+    {
+      frame[out++] = 0;
+    }
+  }
+  return out;
+}
+
+bool LogReader::Push(uint8_t byte)
+{
+  if (byte != 0)
+  {
+    if (m_length < static_cast<int>(sizeof(m_frame)))
+    {
+      m_frame[m_length++] = byte;
+    }
+    else
+    {
+      m_overlong = true;
+    }
+    return false;
+  }
+
+  int length = m_overlong ? -1 : DecodeFrame(m_frame, m_length);
+  bool empty = m_length == 0;
+  m_length = 0;
+  m_overlong = false;
+
+  if (length <= 0)
+  {
+    if (!empty)
+    {
+      ++m_corrupt;
+    }
+    return false;
+  }
+
+  for (int i = 0; i < length; ++i)
+  {
+    m_record[i] = m_frame[i];
+  }
+  m_recordLength = length;
+
+  int position = 1;
+  uint32_t delta = 0;
+  for (int shift = 0; position < length; shift += 7)
+  {
+    uint8_t varint = m_record[position++];
+    delta |= static_cast<uint32_t>(varint & 0x7F) << shift;
+    if (!(varint & 0x80))
+    {
+      break;
+    }
+  }
+  m_payloadStart = position;
+
+  if (Is(LogEventId::Boot))
+  {
+    m_nowMillis = 0;
+  }
+  m_nowMillis += delta;
+  return true;
+}
+
+void LogReader::Print(FILE* output) const
+{
+  uint8_t id = Id();
+  if (id >= EVENT_COUNT)
+  {
+    fprintf(output, "%10.3f  Unknown event %u\n", m_nowMillis / 1000.0, id);
+    return;
+  }
+
+  fprintf(output, "%10.3f  %-22s", m_nowMillis / 1000.0, s_formats[id].name);
+  int position = m_payloadStart;
+  for (const char* field = s_formats[id].fields; *field; ++field)
+  {
+    int size = (*field == 'w' || *field == 'i') ? 2 : *field == 'l' ? 4 : 1;
+    if (position + size > m_recordLength)
+    {
+      fprintf(output, " (truncated)");
+      break;
+    }
+
+    uint32_t value = 0;
+    for (int i = 0; i < size; ++i)
+    {
+      value |= static_cast<uint32_t>(m_record[position++]) << (8 * i);
+    }
+
+    switch (*field)
+    {
+      case 's': fprintf(output, " %s", StateToString(static_cast<TrainStatus>(value))); break;
+      case 'd': fprintf(output, " %s", PointDirectionToString(static_cast<PointsDirection>(value))); break;
+      case 'i': fprintf(output, " %d", static_cast<int16_t>(value)); break;
+      case 'c': fprintf(output, " %c", static_cast<char>(value)); break;
+      default:  fprintf(output, " %u", value); break;
+    }
+  }
+  fprintf(output, "\n");
+}
+
+int EncodeFrame(const uint8_t* data, int length, uint8_t* out)
+{
+  int codeIndex = 0;
+  int size = 1;
+  uint8_t code = 1;
+  for (int i = 0; i < length; ++i)
+  {
+    if (data[i] == 0)
+    {
+      out[codeIndex] = code;
+      codeIndex = size++;
+      code = 1;
+    }
+    else
+    {
+      out[size++] = data[i];
+      ++code;
+    }
+  }
+  out[codeIndex] = code;
+  out[size++] = 0;
+  return size;
+}
\ No newline at end of file
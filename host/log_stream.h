@@ -0,0 +1,47 @@
+#pragma once
+
+// Reading and writing the controller's serial framing (see
+// telemetry.h and console.h), shared by log_decode and the
+// console.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "enums.h"
+
+// Splits the serial stream into records and prints them
+class LogReader
+{
+public:
+  // Take the next byte of the stream. Returns true when it ends a
+  // good record, which can then be looked at until the next one.
+  bool Push(uint8_t byte);
+
+  uint8_t Id() const { return m_record[0]; }
+  bool Is(LogEventId id) const { return Id() == static_cast<uint8_t>(id); }
+  // The record's payload, after its id and time
+  const uint8_t* Payload() const { return m_record + m_payloadStart; }
+  int PayloadLength() const { return m_recordLength - m_payloadStart; }
+
+  // One line with the time since boot, the name and the fields
+  void Print(FILE* output) const;
+
+  // Frames which weren't a record
+  unsigned Corrupt() const { return m_corrupt; }
+
+private:
+  // Frames are short, so anything longer than this is line noise
+  uint8_t m_frame[64];
+  int m_length = 0;
+  bool m_overlong = false;
+
+  uint8_t m_record[64];
+  int m_recordLength = 0;
+  int m_payloadStart = 0;
+  uint64_t m_nowMillis = 0;
+  unsigned m_corrupt = 0;
+};
+
+// COBS encode a frame, with its ending 0, into out, which needs
+// room for length + 2 bytes. Returns the length written.
+int EncodeFrame(const uint8_t* data, int length, uint8_t* out);
\ No newline at end of file
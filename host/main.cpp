@@ -0,0 +1,56 @@
+// Runs the controller natively against the host HAL. With
+// no simulated layout behind it the inputs stay where they
+// are set on the command line, which is enough to profile
+// the control loop for a given picture of the layout, and
+// to see how well the task scheduler keeps to its rates.
+//
+// Usage: train_auto_control_host [loops] [input pin=level ...]
+//   e.g. train_auto_control_host 1000000 7=0 8=0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "hal.h"
+#include "scheduler.h"
+#include "sketch.h"
+
+int main(int argc, char** argv)
+{
+  unsigned long loops = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+
+  Serial.setOutput(nullptr);
+  setup();
+
+  for (int i = 2; i < argc; ++i)
+  {
+    const char* equals = strchr(argv[i], '=');
+    if (!equals)
+    {
+      fprintf(stderr, "Expected pin=level, got %s\n", argv[i]);
+      return 1;
+    }
+    HostSetDigitalInput(atoi(argv[i]), atoi(equals + 1));
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < loops; ++i)
+  {
+    loop();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  printf("%lu loops in %.3f s (%.1f ns/loop)\n", loops, elapsed.count(),
+         loops ? elapsed.count() * 1e9 / loops : 0.0);
+
+  printf("%-10s %10s %9s %14s %13s\n", "Task", "Runs", "Overruns", "Max late (us)", "Max run (us)");
+  for (uint8_t i = 0; i < g_taskCount; ++i)
+  {
+    const Task& task = g_tasks[i];
+    printf("%-10s %10u %9u %14u %13u\n", task.name, task.runs, task.overruns,
+           task.maxLateMicros, task.maxRunMicros);
+  }
+  return 0;
+}
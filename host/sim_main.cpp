@@ -0,0 +1,308 @@
+// Runs the controller against the layout model on a virtual
+// clock, to measure throughput before a change is deployed.
+//
+// Usage: layout_sim [option=value ...]
+//   hours=24          simulated time to run for
+//   tick_ms=10        longest the controller goes without a loop
+//                     when nothing in the layout changes
+//   dwell=512         dwell potentiometer reading (0-1023)
+//   x_throw_ms=1500   time for points X to move
+//   y_throw_ms=1500   time for points Y to move
+//   bounce_ms=0       point feedback contact bounce after each throw
+//   hold_ms=100       current detector hold (overlap) time
+//   dropout_ms=0      current detector dropout length, 0 for none
+//   dropout_period_ms=5000  time between dropouts while occupied
+//   a_fast=300 a_slow=100 b_fast=300 b_slow=100   speeds in mm/s at
+//                     full track power, fast output on and off
+//   a_length=300 b_length=300                     train lengths in mm
+//   log=FILE          write the controller's binary log to FILE,
+//                     for log_decode
+//   eeprom=FILE       load the EEPROM from FILE, if it exists, and
+//                     save it back at the end, so a second run
+//                     starts from where the journal left the first
+//   pty=1             put the controller's serial port on a
+//                     pseudo-terminal, whose name is printed at the
+//                     start, for train_console. Runs in real time.
+//   speed=0           run this many times faster than real time,
+//                     0 for as fast as possible (1 with pty=1)
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+#include "hal.h"
+#include "layout_sim.h"
+#include "sketch.h"
+#include "state_control.h"
+
+#define SPEED_NOT_GIVEN 0xFFFFFFFF
+
+struct SimOptions
+{
+  double hours;
+  uint32_t tickMs;
+  uint32_t speed;
+  uint32_t pty;
+  const char* logPath;
+  const char* eepromPath;
+  LayoutConfig layout;
+};
+
+static bool KeyIs(const char* key, const char* argument, size_t keyLength)
+{
+  return strlen(key) == keyLength && strncmp(key, argument, keyLength) == 0;
+}
+
+static bool ParseOption(SimOptions& options, const char* argument)
+{
+  const char* equals = strchr(argument, '=');
+  if (!equals)
+  {
+    return false;
+  }
+
+  size_t keyLength = equals - argument;
+  const char* value = equals + 1;
+  unsigned long number = strtoul(value, nullptr, 10);
+
+  struct { const char* key; uint32_t* target; } numbers[] = {
+    { "tick_ms",    &options.tickMs },
+    { "speed",      &options.speed },
+    { "pty",        &options.pty },
+    { "x_throw_ms", &options.layout.xThrowMs },
+    { "y_throw_ms", &options.layout.yThrowMs },
+    { "bounce_ms",  &options.layout.bounceMs },
+    { "hold_ms",    &options.layout.detectorHoldMs },
+    { "dropout_ms", &options.layout.dropoutMs },
+    { "dropout_period_ms", &options.layout.dropoutPeriodMs },
+    { "a_fast",     &options.layout.trains[0].fastSpeed },
+    { "a_slow",     &options.layout.trains[0].slowSpeed },
+    { "a_length",   &options.layout.trains[0].length },
+    { "b_fast",     &options.layout.trains[1].fastSpeed },
+    { "b_slow",     &options.layout.trains[1].slowSpeed },
+    { "b_length",   &options.layout.trains[1].length },
+  };
+
+  for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i)
+  {
+    if (KeyIs(numbers[i].key, argument, keyLength))
+    {
+      *numbers[i].target = number;
+      return true;
+    }
+  }
+
+  if (KeyIs("hours", argument, keyLength))
+  {
+    options.hours = atof(value);
+    return true;
+  }
+  if (KeyIs("dwell", argument, keyLength))
+  {
+    options.layout.dwellInput = number > 1023 ? 1023 : number;
+    return true;
+  }
+  if (KeyIs("log", argument, keyLength))
+  {
+    options.logPath = value;
+    return true;
+  }
+  if (KeyIs("eeprom", argument, keyLength))
+  {
+    options.eepromPath = value;
+    return true;
+  }
+  return false;
+}
+
+// Open a pseudo-terminal for the serial port, returning the
+// non-blocking master end or -1. The slave end is kept open and
+// raw, so the console can come and go and nothing is echoed.
+static int OpenPty()
+{
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+  {
+    return -1;
+  }
+
+  const char* name = ptsname(master);
+  int slave = open(name, O_RDWR | O_NOCTTY);
+  if (slave < 0)
+  {
+    return -1;
+  }
+
+  termios settings;
+  tcgetattr(slave, &settings);
+  cfmakeraw(&settings);
+  tcsetattr(slave, TCSANOW, &settings);
+
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  printf("Serial port on %s\n", name);
+  fflush(stdout);
+  return master;
+}
+
+int main(int argc, char** argv)
+{
+  SimOptions options;
+  options.hours = 24;
+  options.tickMs = 10;
+  options.speed = SPEED_NOT_GIVEN;
+  options.pty = 0;
+  options.logPath = nullptr;
+  options.eepromPath = nullptr;
+  options.layout = DefaultLayoutConfig();
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!ParseOption(options, argv[i]))
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if (options.tickMs == 0)
+  {
+    options.tickMs = 1;
+  }
+
+  if (options.speed == SPEED_NOT_GIVEN)
+  {
+    options.speed = options.pty ? 1 : 0;
+  }
+
+  HostUseVirtualClock();
+  FILE* log = nullptr;
+  if (options.logPath)
+  {
+    log = fopen(options.logPath, "wb");
+    if (!log)
+    {
+      fprintf(stderr, "Can't open %s\n", options.logPath);
+      return 1;
+    }
+  }
+  Serial.setOutput(log);
+
+  if (options.pty)
+  {
+    int port = OpenPty();
+    if (port < 0)
+    {
+      fprintf(stderr, "Can't open a pseudo-terminal\n");
+      return 1;
+    }
+    Serial.setPort(port);
+  }
+
+  if (options.eepromPath)
+  {
+    FILE* eeprom = fopen(options.eepromPath, "rb");
+    if (eeprom)
+    {
+      fread(HostEeprom(), 1, HAL_EEPROM_SIZE, eeprom);
+      fclose(eeprom);
+    }
+  }
+
+  LayoutSim layout(options.layout);
+  layout.WriteInputs();
+
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+  setup();
+
+  uint64_t endMicros = static_cast<uint64_t>(options.hours * 3600e6);
+  uint64_t tickMicros = static_cast<uint64_t>(options.tickMs) * 1000;
+  uint64_t loops = 0;
+  uint64_t statusMicros[TRAIN_STATUS_COUNT] = {};
+  uint32_t statusEntries[TRAIN_STATUS_COUNT] = {};
+  TrainStatus lastStatus = g_currentStatus;
+  uint64_t lastStatusChange = HostNowMicros();
+
+  while (HostNowMicros() < endMicros)
+  {
+    // Catch the layout up with the time the controller has used
+    // (it may have delayed), then apply what it has just output.
+    layout.ReadOutputs(HostNowMicros());
+
+    uint64_t next = layout.NextEventMicros();
+    if (next > layout.NowMicros() + tickMicros)
+    {
+      next = layout.NowMicros() + tickMicros;
+    }
+
+    if (options.speed)
+    {
+      // Hold the virtual clock back to real time
+      std::this_thread::sleep_until(wallStart + std::chrono::microseconds(next / options.speed));
+    }
+
+    HostSetMicros(next);
+    layout.AdvanceTo(next);
+    layout.WriteInputs();
+
+    loop();
+    ++loops;
+
+    if (g_currentStatus != lastStatus)
+    {
+      uint64_t now = HostNowMicros();
+      statusMicros[static_cast<int>(lastStatus)] += now - lastStatusChange;
+      ++statusEntries[static_cast<int>(g_currentStatus)];
+      lastStatus = g_currentStatus;
+      lastStatusChange = now;
+    }
+  }
+
+  statusMicros[static_cast<int>(lastStatus)] += HostNowMicros() - lastStatusChange;
+
+  std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wallStart;
+  double simHours = HostNowMicros() / 3600e6;
+  uint32_t lapsA = layout.Train(0).laps;
+  uint32_t lapsB = layout.Train(1).laps;
+
+  printf("Simulated %.2f h in %.2f s (%.0fx real time), %llu loops\n",
+         simHours, wall.count(), wall.count() > 0 ? simHours * 3600 / wall.count() : 0.0,
+         static_cast<unsigned long long>(loops));
+  printf("Round trips: A %u, B %u, %.1f per hour\n", lapsA, lapsB, (lapsA + lapsB) / simHours);
+  printf("Layout faults: %u\n", layout.Faults());
+  printf("%-18s %8s %12s\n", "State", "Entries", "Time (s)");
+  for (int status = 0; status < TRAIN_STATUS_COUNT; ++status)
+  {
+    if (statusEntries[status] == 0 && statusMicros[status] == 0)
+    {
+      continue;
+    }
+    printf("%-18s %8u %12.1f\n", StateToString(static_cast<TrainStatus>(status)),
+           statusEntries[status], statusMicros[status] / 1e6);
+  }
+
+  if (log)
+  {
+    fclose(log);
+  }
+
+  if (options.eepromPath)
+  {
+    FILE* eeprom = fopen(options.eepromPath, "wb");
+    if (!eeprom)
+    {
+      fprintf(stderr, "Can't write %s\n", options.eepromPath);
+      return 1;
+    }
+    fwrite(HostEeprom(), 1, HAL_EEPROM_SIZE, eeprom);
+    fclose(eeprom);
+  }
+
+  return layout.Faults() ? 2 : 0;
+}
@@ -0,0 +1,4 @@
+// Builds the sketch's .ino as ordinary C++ for the host. The
+// Arduino IDE adds the core include for us, so do the same here.
+#include "hal.h"
+#include "train_auto_control.ino"
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+// Entry points of the sketch (train_auto_control.ino) for
+// host programs which drive the controller themselves.
+void HandleNextState();
+void setup();
+void loop();
+
+// The sketch's task table, for reporting its statistics
+struct Task;
+extern Task g_tasks[];
+extern uint8_t g_taskCount;
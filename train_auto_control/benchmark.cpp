@@ -0,0 +1,269 @@
+#include "benchmark.h"
+
+#include "inputs.h"
+#include "layout.h"
+#include "point_control.h"
+#include "telemetry.h"
+#include "state_control.h"
+#include "train_control.h"
+
+// Defined in train_auto_control.ino
+void HandleNextState();
+
+// Per-state functions from state_control.cpp. They aren't part
+// of its interface, but are what we want to time.
+TrainStatus NextStatusForBothInPlatform();
+TrainStatus NextStatusForTrainADeparture();
+TrainStatus NextStatusForTrainAOnLine();
+TrainStatus NextStatusForTrainAArrival();
+TrainStatus NextStatusForTrainBDeparture();
+TrainStatus NextStatusForTrainBOnLine();
+TrainStatus NextStatusForTrainBArrival();
+
+extern uint32_t g_departureTime;
+
+// Samples per benchmark. The AVR only has room for a few,
+// and its counter saturates at 16 bits anyway.
+#if defined(__AVR__)
+#define BENCH_SAMPLES 128
+typedef uint16_t BenchSample;
+#else
+#define BENCH_SAMPLES 4096
+typedef uint32_t BenchSample;
+#endif
+
+static BenchSample s_samples[BENCH_SAMPLES];
+
+// Cost of reading the counter around an empty call, taken
+// off every sample.
+static BenchSample s_overhead = 0;
+
+// Input snapshots for the situations being timed
+#define BENCH_BOTH_IN_PLATFORM (INPUT_TRAIN_A_IN_PLATFORM | INPUT_TRAIN_B_IN_PLATFORM)
+#define BENCH_POINTS_FOR_A     (INPUT_POINT_X_PLAT_A_FEEDBACK | INPUT_POINT_Y_PLAT_A_FEEDBACK)
+#define BENCH_POINTS_FOR_B     (INPUT_POINT_X_PLAT_B_FEEDBACK | INPUT_POINT_Y_PLAT_B_FEEDBACK)
+
+// Shell sort, small enough for the AVR and quick enough
+// for the host's larger sample count.
+static void SortSamples()
+{
+  for (uint16_t gap = BENCH_SAMPLES / 2; gap > 0; gap /= 2)
+  {
+    for (uint16_t i = gap; i < BENCH_SAMPLES; ++i)
+    {
+      BenchSample sample = s_samples[i];
+      uint16_t j = i;
+      for (; j >= gap && s_samples[j - gap] > sample; j -= gap)
+      {
+        s_samples[j] = s_samples[j - gap];
+      }
+      s_samples[j] = sample;
+    }
+  }
+}
+
+static uint32_t TicksToNanoseconds(BenchSample ticks)
+{
+  return static_cast<uint32_t>(ticks) * 1000UL / HAL_COUNTER_TICKS_PER_US;
+}
+
+static void PrintNanoseconds(const __FlashStringHelper* label, BenchSample ticks)
+{
+  PRINT(label); PRINT(TicksToNanoseconds(ticks));
+}
+
+// Time BENCH_SAMPLES calls of run, each after a call of prepare
+// to put the controller back into the situation being timed,
+// and report min, median, p99 and max in nanoseconds.
+static void RunBenchmark(const __FlashStringHelper* name, void (*prepare)(), void (*run)())
+{
+  for (uint16_t i = 0; i < BENCH_SAMPLES; ++i)
+  {
+    prepare();
+    HalResetCycleCounter();
+    run();
+    BenchSample ticks = HalReadCycleCounter();
+    s_samples[i] = ticks > s_overhead ? ticks - s_overhead : 0;
+  }
+
+  SortSamples();
+
+  PRINT(name);
+  PrintNanoseconds(F(": min "), s_samples[0]);
+  PrintNanoseconds(F(" median "), s_samples[BENCH_SAMPLES / 2]);
+  PrintNanoseconds(F(" p99 "), s_samples[BENCH_SAMPLES - 1 - BENCH_SAMPLES / 100]);
+  PrintNanoseconds(F(" max "), s_samples[BENCH_SAMPLES - 1]);
+  PRINTLN(F(" ns"));
+}
+
+// Present the inputs as the state machine sees them, once
+// they've been steady for longer than any detector hold-off
+// and enough point feedback samples have been taken
+static void SetInputs(InputSnapshot inputs)
+{
+  g_inputs = inputs;
+  UpdateOccupancy();
+  g_inputsMicros += SENSOR_HOLDOFF_MAX * 1000UL;
+  UpdateOccupancy();
+
+  for (uint8_t sample = 0; sample < POINT_FEEDBACK_SAMPLES; ++sample)
+  {
+    g_inputsMicros += POINT_FEEDBACK_PERIOD * 1000UL;
+    PollPoints();
+  }
+}
+
+static void PrepareNothing()
+{
+}
+
+// Waiting out the dwell, the state the controller spends most
+// of its time in. HandleNextState reads the real inputs, so this
+// expects both trains to be in their platforms.
+static void PrepareBothInPlatform()
+{
+  SetInputs(BENCH_BOTH_IN_PLATFORM | BENCH_POINTS_FOR_A);
+  g_previousStatus = TrainStatus::TrainBArrival;
+  g_currentStatus = TrainStatus::BothInPlatform;
+  g_nextStatus = TrainStatus::BothInPlatform;
+  g_departureTime = HalMillis() + 3600000UL;
+}
+
+static void PrepareTrainAOnSlowX()
+{
+  SetInputs(INPUT_TRAIN_B_IN_PLATFORM | INPUT_TRAIN_ON_SLOW_X | BENCH_POINTS_FOR_A);
+}
+
+static void PrepareTrainAOnLine()
+{
+  SetInputs(INPUT_TRAIN_B_IN_PLATFORM | INPUT_TRAIN_ON_LINE | BENCH_POINTS_FOR_A);
+}
+
+static void PrepareTrainAOnSlowY()
+{
+  SetInputs(INPUT_TRAIN_B_IN_PLATFORM | INPUT_TRAIN_ON_SLOW_Y | BENCH_POINTS_FOR_A);
+}
+
+static void PrepareTrainBOnSlowY()
+{
+  SetInputs(INPUT_TRAIN_A_IN_PLATFORM | INPUT_TRAIN_ON_SLOW_Y | BENCH_POINTS_FOR_B);
+}
+
+static void PrepareTrainBOnLine()
+{
+  SetInputs(INPUT_TRAIN_A_IN_PLATFORM | INPUT_TRAIN_ON_LINE | BENCH_POINTS_FOR_B);
+}
+
+static void PrepareTrainBOnSlowX()
+{
+  SetInputs(INPUT_TRAIN_A_IN_PLATFORM | INPUT_TRAIN_ON_SLOW_X | BENCH_POINTS_FOR_B);
+}
+
+// Leaving the platform. The points have been asked to move but
+// nothing polls them here, so this times the throw-pending path.
+static void PrepareTrainADepartureFromPlatform()
+{
+  PrepareBothInPlatform();
+  g_nextStatus = TrainStatus::TrainADeparture;
+}
+
+static void PrepareTrainBDepartureFromPlatform()
+{
+  PrepareBothInPlatform();
+  g_nextStatus = TrainStatus::TrainBDeparture;
+}
+
+static void PrepareRecoveryToBothInPlatform()
+{
+  g_currentStatus = TrainStatus::TrainMissing;
+  g_nextStatus = TrainStatus::BothInPlatform;
+}
+
+static void PrepareTransition(TrainStatus from, TrainStatus to)
+{
+  g_currentStatus = from;
+  g_nextStatus = to;
+}
+
+static void PrepareTrainAOnLineNext()      { PrepareTransition(TrainStatus::TrainADeparture, TrainStatus::TrainAOnLine); }
+static void PrepareTrainAArrivalNext()     { PrepareTransition(TrainStatus::TrainAOnLine, TrainStatus::TrainAArrival); }
+static void PrepareTrainAInPlatformNext()  { PrepareTransition(TrainStatus::TrainAArrival, TrainStatus::BothInPlatform); }
+static void PrepareTrainBOnLineNext()      { PrepareTransition(TrainStatus::TrainBDeparture, TrainStatus::TrainBOnLine); }
+static void PrepareTrainBArrivalNext()     { PrepareTransition(TrainStatus::TrainBOnLine, TrainStatus::TrainBArrival); }
+static void PrepareTrainBInPlatformNext()  { PrepareTransition(TrainStatus::TrainBArrival, TrainStatus::BothInPlatform); }
+static void PrepareTrainMissingNext()      { PrepareTransition(TrainStatus::TrainAOnLine, TrainStatus::TrainMissing); }
+
+// Step through every track power state in turn
+static void CycleTrackPowerState()
+{
+  static uint8_t state = 0;
+  SetTrackPowerState(TrackPowerSpeed(static_cast<TrackPowerState>(state)));
+  UpdateTrackSpeed();
+  state = (state + 1) % (static_cast<uint8_t>(TrackPowerState::ReverseFast) + 1);
+}
+
+// Toggle the direction output through the core's lookup
+// and through Pin<N>, to compare the two
+static void ToggleDirectionPin()
+{
+  static uint8_t value = 0;
+  value ^= 1;
+  HalDigitalWrite(TRACK_DIRECTION_PIN, value);
+}
+
+static void ToggleDirectionPinFast()
+{
+  static uint8_t value = 0;
+  value ^= 1;
+  Pin<TRACK_DIRECTION_PIN>::Write(value);
+}
+
+// Times each part of the control loop and prints the results
+// over serial. These call the real output functions, so on the
+// Arduino run them with the layout isolated.
+void RunBenchmarks()
+{
+  // The results are text, so keep the binary log out of them
+  TelemetryEnd();
+
+  // Measure the cost of the measurement itself first
+  s_overhead = 0;
+  for (uint16_t i = 0; i < BENCH_SAMPLES; ++i)
+  {
+    HalResetCycleCounter();
+    PrepareNothing();
+    s_samples[i] = HalReadCycleCounter();
+  }
+  SortSamples();
+  s_overhead = s_samples[0];
+  PrintNanoseconds(F("Counter overhead "), s_overhead);
+  PRINTLN(F(" ns"));
+
+  RunBenchmark(F("HandleNextState"), PrepareBothInPlatform, [] { HandleNextState(); });
+
+  RunBenchmark(F("NextStatusForBothInPlatform"), PrepareBothInPlatform, [] { NextStatusForBothInPlatform(); });
+  RunBenchmark(F("NextStatusForTrainADeparture"), PrepareTrainAOnSlowX, [] { NextStatusForTrainADeparture(); });
+  RunBenchmark(F("NextStatusForTrainAOnLine"), PrepareTrainAOnLine, [] { NextStatusForTrainAOnLine(); });
+  RunBenchmark(F("NextStatusForTrainAArrival"), PrepareTrainAOnSlowY, [] { NextStatusForTrainAArrival(); });
+  RunBenchmark(F("NextStatusForTrainBDeparture"), PrepareTrainBOnSlowY, [] { NextStatusForTrainBDeparture(); });
+  RunBenchmark(F("NextStatusForTrainBOnLine"), PrepareTrainBOnLine, [] { NextStatusForTrainBOnLine(); });
+  RunBenchmark(F("NextStatusForTrainBArrival"), PrepareTrainBOnSlowX, [] { NextStatusForTrainBArrival(); });
+
+  RunBenchmark(F("TransitionState TrainMissing->BothInPlatform"), PrepareRecoveryToBothInPlatform, [] { TransitionState(); });
+  RunBenchmark(F("TransitionState BothInPlatform->TrainADeparture"), PrepareTrainADepartureFromPlatform, [] { TransitionState(); });
+  RunBenchmark(F("TransitionState BothInPlatform->TrainBDeparture"), PrepareTrainBDepartureFromPlatform, [] { TransitionState(); });
+  RunBenchmark(F("TransitionState TrainADeparture->TrainAOnLine"), PrepareTrainAOnLineNext, [] { TransitionState(); });
+  RunBenchmark(F("TransitionState TrainAOnLine->TrainAArrival"), PrepareTrainAArrivalNext, [] { TransitionState(); });
+  RunBenchmark(F("TransitionState TrainAArrival->BothInPlatform"), PrepareTrainAInPlatformNext, [] { TransitionState(); });
+  RunBenchmark(F("TransitionState TrainBDeparture->TrainBOnLine"), PrepareTrainBOnLineNext, [] { TransitionState(); });
+  RunBenchmark(F("TransitionState TrainBOnLine->TrainBArrival"), PrepareTrainBArrivalNext, [] { TransitionState(); });
+  RunBenchmark(F("TransitionState TrainBArrival->BothInPlatform"), PrepareTrainBInPlatformNext, [] { TransitionState(); });
+  RunBenchmark(F("TransitionState TrainAOnLine->TrainMissing"), PrepareTrainMissingNext, [] { TransitionState(); });
+
+  RunBenchmark(F("SetTrackPowerState+UpdateTrackSpeed"), PrepareNothing, CycleTrackPowerState);
+  RunBenchmark(F("HalDigitalWrite"), PrepareNothing, ToggleDirectionPin);
+  RunBenchmark(F("Pin<N>::Write"), PrepareNothing, ToggleDirectionPinFast);
+
+  // Leave the track stopped whatever the last state timed was
+  StopTrack();
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+
+void RunBenchmarks();
@@ -0,0 +1,207 @@
+#include "config.h"
+
+#include <string.h>
+
+// Longest dwell which can be scaled by the 10 bit
+// potentiometer reading without overflowing
+#define CONFIG_DWELL_MAX (0xFFFFFFFFul / 1024)
+
+// Read a setting out of a Config. Returns false if there's no
+// such setting.
+static bool ReadItem(const Config& config, ConfigItem item, uint32_t& value)
+{
+  switch (item)
+  {
+    case ConfigItem::PlatformDwellTime:   value = config.platformDwellTime;   return true;
+    case ConfigItem::SensorDebounceDelay: value = config.sensorDebounceDelay; return true;
+    case ConfigItem::PointWaitPeriod:     value = config.pointWaitPeriod;     return true;
+    case ConfigItem::PointWaitCount:      value = config.pointWaitCount;      return true;
+    case ConfigItem::PointControlInvert:  value = config.pointControlInvert;  return true;
+    case ConfigItem::FeedbackInvert:      value = config.feedbackInvert;      return true;
+    case ConfigItem::TrackPower:          value = config.trackPower;          return true;
+    case ConfigItem::Forward:             value = config.forward;             return true;
+    case ConfigItem::TrackFast:           value = config.trackFast;           return true;
+  }
+  return false;
+}
+
+// How long a throw of the points has to confirm (ms)
+uint32_t PointThrowTimeout()
+{
+  return static_cast<uint32_t>(g_config.pointWaitCount) * g_config.pointWaitPeriod;
+}
+
+#if defined(_CONFIG_FIXED)
+
+bool GetConfigItem(ConfigItem item, uint32_t& value)
+{
+  return ReadItem(g_config, item, value);
+}
+
+// Nothing can be changed in a fixed build
+bool SetConfigItem(ConfigItem, uint32_t)
+{
+  return false;
+}
+
+#else
+
+// Bump when Config changes, so older saved settings
+// no longer check out
+#define CONFIG_VERSION 1
+
+static const Config s_defaults = CONFIG_DEFAULTS;
+
+Config g_config = CONFIG_DEFAULTS;
+
+// The settings as saved, or about to be. Polarity changes only
+// reach g_config at the next reset.
+static Config s_saved = CONFIG_DEFAULTS;
+
+// Records are seeded with the defaults as well as the version, so
+// building with different defaults in defines.h starts from them
+// rather than from settings saved against the old ones
+static uint16_t s_seed = 0;
+
+// Sequence of the newest copy
+static uint8_t s_sequence = 0;
+
+// The record being written, a byte at a time
+static uint8_t s_writeBuffer[CONFIG_RECORD_SIZE];
+static uint16_t s_writeAddress = 0;
+static uint8_t s_writeIndex = CONFIG_RECORD_SIZE;
+
+// True if sequence number a was written after b
+static bool Newer(uint8_t a, uint8_t b)
+{
+  uint8_t ahead = a - b;
+  return ahead != 0 && ahead < 128;
+}
+
+// Read back the newest saved settings, if any check out, into
+// g_config. Call first thing at start up, before anything reads
+// g_config. Returns the flags for the ConfigLoaded log record,
+// which can't be logged until the log has started.
+uint8_t LoadConfig()
+{
+  s_seed = RecordCrc(reinterpret_cast<const uint8_t*>(&s_defaults), sizeof(s_defaults),
+                     RecordSeed(CONFIG_VERSION));
+
+  uint8_t newest[CONFIG_RECORD_SIZE];
+  bool found = false;
+  for (uint8_t copy = 0; copy < 2; ++copy)
+  {
+    uint8_t record[CONFIG_RECORD_SIZE];
+    if (ReadRecord(CONFIG_EEPROM_BASE + copy * CONFIG_RECORD_SIZE, record, sizeof(record), s_seed) &&
+        (!found || Newer(record[0], newest[0])))
+    {
+      memcpy(newest, record, sizeof(newest));
+      found = true;
+    }
+  }
+
+  if (found)
+  {
+    s_sequence = newest[0];
+    memcpy(&s_saved, newest + 1, sizeof(s_saved));
+    g_config = s_saved;
+  }
+
+  return found ? CONFIG_SAVED_FOUND : 0;
+}
+
+// Queue the saved settings to be written over the older copy.
+// Starts over if a write is already in progress.
+static void QueueSave()
+{
+  s_writeBuffer[0] = ++s_sequence;
+  memcpy(s_writeBuffer + 1, &s_saved, sizeof(s_saved));
+  SealRecord(s_writeBuffer, sizeof(s_writeBuffer), s_seed);
+
+  s_writeAddress = CONFIG_EEPROM_BASE + (s_sequence & 1) * CONFIG_RECORD_SIZE;
+  s_writeIndex = 0;
+}
+
+// Write the next byte of a save in progress, skipping bytes
+// which already hold the right value
+void UpdateConfig()
+{
+  while (s_writeIndex < CONFIG_RECORD_SIZE && HalEepromReady())
+  {
+    uint16_t address = s_writeAddress + s_writeIndex;
+    uint8_t value = s_writeBuffer[s_writeIndex++];
+    if (HalEepromRead(address) != value)
+    {
+      HalEepromWrite(address, value);
+      return;
+    }
+  }
+}
+
+// Read a setting, as saved. Returns false if there's no such setting.
+bool GetConfigItem(ConfigItem item, uint32_t& value)
+{
+  return ReadItem(s_saved, item, value);
+}
+
+// Change a setting and save it. Returns false, leaving it as it
+// was, if there's no such setting or the value is out of its range.
+bool SetConfigItem(ConfigItem item, uint32_t value)
+{
+  switch (item)
+  {
+    case ConfigItem::PlatformDwellTime:
+      if (value > CONFIG_DWELL_MAX) { return false; }
+      g_config.platformDwellTime = s_saved.platformDwellTime = value;
+      break;
+
+    case ConfigItem::SensorDebounceDelay:
+      if (value < SENSOR_HOLDOFF_MIN || value > SENSOR_HOLDOFF_MAX) { return false; }
+      g_config.sensorDebounceDelay = s_saved.sensorDebounceDelay = value;
+      break;
+
+    case ConfigItem::PointWaitPeriod:
+      if (value == 0 || value > 0xFFFF) { return false; }
+      g_config.pointWaitPeriod = s_saved.pointWaitPeriod = value;
+      break;
+
+    case ConfigItem::PointWaitCount:
+      if (value == 0 || value > 0xFFFF) { return false; }
+      g_config.pointWaitCount = s_saved.pointWaitCount = value;
+      break;
+
+    case ConfigItem::PointControlInvert:
+      if (value >= (1u << LAYOUT_POINTS_COUNT)) { return false; }
+      s_saved.pointControlInvert = value;
+      break;
+
+    case ConfigItem::FeedbackInvert:
+      if (value > (CONFIG_FEEDBACK_X_PLAT_A | CONFIG_FEEDBACK_X_PLAT_B |
+                   CONFIG_FEEDBACK_Y_PLAT_A | CONFIG_FEEDBACK_Y_PLAT_B)) { return false; }
+      s_saved.feedbackInvert = value;
+      break;
+
+    case ConfigItem::TrackPower:
+      if (value > 1) { return false; }
+      s_saved.trackPower = value;
+      break;
+
+    case ConfigItem::Forward:
+      if (value > 1) { return false; }
+      s_saved.forward = value;
+      break;
+
+    case ConfigItem::TrackFast:
+      if (value > 1) { return false; }
+      s_saved.trackFast = value;
+      break;
+
+    default:
+      return false;
+  }
+
+  QueueSave();
+  return true;
+}
+
+#endif
\ No newline at end of file
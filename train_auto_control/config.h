@@ -0,0 +1,85 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+#include "eeprom_record.h"
+#include "enums.h"
+#include "layout.h"
+#include "telemetry.h"
+
+// Settings which are tuned for a layout rather than built in. They
+// start from the defaults in defines.h and are kept in EEPROM, so a
+// change made through the console (see console.h) survives a reset
+// without reflashing. The timings take effect straight away, the
+// polarities from the next reset, as changing them under running
+// trains would drive the outputs the wrong way.
+//
+// With _CONFIG_FIXED the defaults are compile time constants
+// instead, so reading a setting costs nothing over the define, and
+// they can't be changed.
+struct Config
+{
+  // Longest dwell, with the dwell potentiometer at full (ms)
+  uint32_t platformDwellTime;
+  // Detector hold-off until it has learned its own (ms)
+  uint16_t sensorDebounceDelay;
+  // Points have pointWaitCount * pointWaitPeriod ms to confirm
+  uint16_t pointWaitPeriod;
+  uint16_t pointWaitCount;
+  // Bit per set of points (1 << LAYOUT_POINTS_*) whose control
+  // output is high for train A
+  uint8_t pointControlInvert;
+  // Bit per point feedback input (CONFIG_FEEDBACK_*) which is
+  // active low
+  uint8_t feedbackInvert;
+  // Output levels for track power on, train A forward and fast
+  uint8_t trackPower;
+  uint8_t forward;
+  uint8_t trackFast;
+};
+
+#define CONFIG_FEEDBACK_X_PLAT_A (1u << 0)
+#define CONFIG_FEEDBACK_X_PLAT_B (1u << 1)
+#define CONFIG_FEEDBACK_Y_PLAT_A (1u << 2)
+#define CONFIG_FEEDBACK_Y_PLAT_B (1u << 3)
+
+#define CONFIG_DEFAULTS {                                                 \
+  PLATFORM_DWELL_TIME,                                                    \
+  SENSOR_DEBOUNCE_DELAY,                                                  \
+  POINT_WAIT_PERIOD,                                                      \
+  POINT_WAIT_COUNT,                                                       \
+  (INVERT_X_POINT_CONTROL ? 1u << LAYOUT_POINTS_X : 0) |                  \
+  (INVERT_Y_POINT_CONTROL ? 1u << LAYOUT_POINTS_Y : 0),                   \
+  (INVERT_X_PLAT_A_POINT_FEEDBACK ? CONFIG_FEEDBACK_X_PLAT_A : 0) |       \
+  (INVERT_X_PLAT_B_POINT_FEEDBACK ? CONFIG_FEEDBACK_X_PLAT_B : 0) |       \
+  (INVERT_Y_PLAT_A_POINT_FEEDBACK ? CONFIG_FEEDBACK_Y_PLAT_A : 0) |       \
+  (INVERT_Y_PLAT_B_POINT_FEEDBACK ? CONFIG_FEEDBACK_Y_PLAT_B : 0),        \
+  TRACK_POWER,                                                            \
+  FORWARD,                                                                \
+  TRACK_FAST                                                              \
+}
+
+// Two copies of the saved settings, written alternately so one
+// torn by the power going leaves the other, at the top of the
+// EEPROM above the journal. Each is a sequence number, the Config
+// and a CRC.
+#define CONFIG_RECORD_SIZE (1 + sizeof(Config) + 2)
+#define CONFIG_EEPROM_BASE (HAL_EEPROM_SIZE - 2 * CONFIG_RECORD_SIZE)
+
+// Flag in the ConfigLoaded log record
+#define CONFIG_SAVED_FOUND 0x01
+
+#if defined(_CONFIG_FIXED)
+constexpr Config g_config = CONFIG_DEFAULTS;
+inline uint8_t LoadConfig() { return 0; }
+inline void UpdateConfig() {}
+#else
+extern Config g_config;
+uint8_t LoadConfig();
+void UpdateConfig();
+#endif
+
+bool GetConfigItem(ConfigItem item, uint32_t& value);
+bool SetConfigItem(ConfigItem item, uint32_t value);
+uint32_t PointThrowTimeout();
\ No newline at end of file
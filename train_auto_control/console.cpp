@@ -0,0 +1,177 @@
+#include "console.h"
+
+#if defined(_CONSOLE)
+
+#if !defined(_TELEMETRY)
+#error _CONSOLE replies through the log, so needs _TELEMETRY
+#endif
+
+// Longest command is Set: command, item and a uint32,
+// plus a byte of COBS overhead
+#define CONSOLE_FRAME_SIZE 8
+
+// Sent in the ConsoleAck for a frame which couldn't be decoded
+#define CONSOLE_NO_COMMAND 0xFF
+
+// The frame coming in, COBS encoded
+static uint8_t s_frame[CONSOLE_FRAME_SIZE];
+static uint8_t s_length = 0;
+static bool s_overlong = false;
+
+// Undo the COBS framing in place, returning the decoded
+// length or -1 if the frame is corrupt.
+static int8_t DecodeFrame(uint8_t* frame, uint8_t length)
+{
+  uint8_t in = 0;
+  uint8_t out = 0;
+  while (in < length)
+  {
+    uint8_t code = frame[in++];
+    if (code == 0 || in + code - 1 > length)
+    {
+      return -1;
+    }
+    for (uint8_t i = 1; i < code; ++i)
+    {
+      frame[out++] = frame[in++];
+    }
+    if (code < 0xFF && in < length)
+    {
+      frame[out++] = 0;
+    }
+  }
+  return out;
+}
+
+static void LogConfig(ConfigItem item, uint32_t value)
+{
+  uint8_t payload[] = {
+    static_cast<uint8_t>(item),
+    static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8),
+    static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 24)
+  };
+  LogEvent(LogEventId::ConsoleConfig, payload, sizeof(payload));
+}
+
+static void LogSnapshot()
+{
+  uint8_t payload[] = {
+    static_cast<uint8_t>(g_inputs), static_cast<uint8_t>(g_inputs >> 8),
+    static_cast<uint8_t>(GetXPointFeedbackStatus()),
+    static_cast<uint8_t>(GetYPointFeedbackStatus())
+  };
+  LogEvent(LogEventId::ConsoleSnapshot, payload, sizeof(payload));
+
+  for (uint8_t district = 0; district < LAYOUT_DISTRICT_COUNT; ++district)
+  {
+    TrackSpeed current = GetDistrictSpeed(district);
+    TrackSpeed target = GetDistrictTargetSpeed(district);
+    uint8_t speeds[] = {
+      district,
+      static_cast<uint8_t>(current), static_cast<uint8_t>(current >> 8),
+      static_cast<uint8_t>(target), static_cast<uint8_t>(target >> 8)
+    };
+    LogEvent(LogEventId::ConsoleSpeed, speeds, sizeof(speeds));
+  }
+}
+
+// Carry out a decoded command, logging its reply
+static ConsoleResult RunCommand(const uint8_t* frame, uint8_t length)
+{
+  ConsoleCommand command = static_cast<ConsoleCommand>(frame[0]);
+  ConfigItem item = static_cast<ConfigItem>(frame[1]);
+  uint32_t value = 0;
+
+  switch (command)
+  {
+    case ConsoleCommand::Status:
+      LogEvent(LogEventId::ConsoleStatus, static_cast<uint8_t>(g_currentStatus),
+               static_cast<uint8_t>(g_previousStatus), static_cast<uint8_t>(g_nextStatus));
+      return ConsoleResult::Ok;
+
+    case ConsoleCommand::Snapshot:
+      LogSnapshot();
+      return ConsoleResult::Ok;
+
+    case ConsoleCommand::Stats:
+      StartStatsDump();
+      return ConsoleResult::Ok;
+
+    case ConsoleCommand::Get:
+      if (length != 2 || !GetConfigItem(item, value))
+      {
+        return ConsoleResult::BadArgument;
+      }
+      LogConfig(item, value);
+      return ConsoleResult::Ok;
+
+    case ConsoleCommand::Set:
+      if (length != 6)
+      {
+        return ConsoleResult::BadArgument;
+      }
+      for (uint8_t i = 0; i < 4; ++i)
+      {
+        value |= static_cast<uint32_t>(frame[2 + i]) << (8 * i);
+      }
+      if (!SetConfigItem(item, value))
+      {
+        return ConsoleResult::BadArgument;
+      }
+      GetConfigItem(item, value);
+      LogConfig(item, value);
+      return ConsoleResult::Ok;
+
+    case ConsoleCommand::Stop:
+      RequestStop(true);
+      return ConsoleResult::Ok;
+
+    case ConsoleCommand::Resume:
+      RequestStop(false);
+      return ConsoleResult::Ok;
+  }
+
+  return ConsoleResult::UnknownCommand;
+}
+
+// Read whatever has arrived, and carry out each command as
+// its frame completes
+void UpdateConsole()
+{
+  int available = Serial.available();
+  while (available-- > 0)
+  {
+    uint8_t byte = static_cast<uint8_t>(Serial.read());
+    if (byte != 0)
+    {
+      if (s_length < CONSOLE_FRAME_SIZE)
+      {
+        s_frame[s_length++] = byte;
+      }
+      else
+      {
+        s_overlong = true;
+      }
+      continue;
+    }
+
+    if (s_length > 0)
+    {
+      int8_t length = s_overlong ? -1 : DecodeFrame(s_frame, s_length);
+      if (length > 0)
+      {
+        ConsoleResult result = RunCommand(s_frame, length);
+        LogEvent(LogEventId::ConsoleAck, s_frame[0], static_cast<uint8_t>(result));
+      }
+      else
+      {
+        LogEvent(LogEventId::ConsoleAck, CONSOLE_NO_COMMAND, static_cast<uint8_t>(ConsoleResult::BadFrame));
+      }
+    }
+
+    s_length = 0;
+    s_overlong = false;
+  }
+}
+
+#endif
\ No newline at end of file
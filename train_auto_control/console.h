@@ -0,0 +1,39 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+#include "config.h"
+#include "enums.h"
+#include "inputs.h"
+#include "layout.h"
+#include "point_control.h"
+#include "state_control.h"
+#include "stats.h"
+#include "telemetry.h"
+#include "train_control.h"
+
+// Command console on the serial port the log goes out on, for
+// looking at and tuning the controller while it runs. Commands
+// are framed like log records (COBS, ended by a 0 byte): a
+// ConsoleCommand followed by its arguments, little endian.
+// Replies are log records, so they come back in order with the
+// rest of the log: the command's own records, if any, then a
+// ConsoleAck with its ConsoleResult.
+//   Status              ConsoleStatus current, previous and next status
+//   Snapshot            ConsoleSnapshot inputs and points feedback,
+//                       then ConsoleSpeed for each district
+//   Stats               the Stats records (see stats.h), a few at a time
+//   Get item            ConsoleConfig with the ConfigItem's value
+//   Set item uint32     ConsoleConfig with the ConfigItem's new value,
+//                       which is saved (see config.h)
+//   Stop                stop everything, holding in Stopped
+//   Resume              carry on from wherever the trains are
+// UpdateConsole only takes bytes which have already arrived, so it
+// never holds up the loop. host/console_main.cpp is the other end.
+
+#if defined(_CONSOLE)
+void UpdateConsole();
+#else
+inline void UpdateConsole() {}
+#endif
\ No newline at end of file
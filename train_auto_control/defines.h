@@ -7,6 +7,10 @@
 
 // Total size of input pin array
 #define INPUT_COUNT              10
+// The first DIGITAL_INPUT_COUNT entries of the input pin
+// array are sampled into the input snapshot each loop, the 
+// rest are analogue.
+#define DIGITAL_INPUT_COUNT      9
 
 // Signals whether train A is in the platform
 // using an infrared sensor under the track.
@@ -60,8 +64,14 @@
 // at base ERROR_CODE_BASE
 #define ERROR_CODE_BASE      A3
 #define ERROR_CODE_BITS      3
+// The code flashes, alternating with 0, so it can't be taken
+// for a steady 0 (no error). Times in ms.
+#define ERROR_BLINK_ON_TIME  750
+#define ERROR_BLINK_OFF_TIME 250
 
-// Control whether points are A or B when 0 or 1
+// Control whether points are A or B when 0 or 1. These and
+// the polarities below are defaults, which the console can change
+// from the next reset (see config.h).
 // If CONTROL == 0, A == 0 and B == 1
 // If CONTROL == 1, A == 1 and B == 0
 #define INVERT_X_POINT_CONTROL  1
@@ -82,24 +92,86 @@
 // the locomotive move at the higher speed
 #define TRACK_FAST  1
 
+// Uncomment to drive TRACK_POWER_PIN with PWM for the speed,
+// holding TRACK_FAST_PIN at fast while moving, so trains ramp
+// up and down. TRACK_POWER_PIN must then feed a motor driver's
+// enable input, not a relay, and slow is a fraction of the fast
+// supply. Left off, track power is on/off, with TRACK_FAST_PIN
+// set above TRACK_SPEED_SLOW and changed straight away.
+//#define _TRACK_PWM
+
+// Track speeds as PWM duty, out of TRACK_SPEED_MAX
+#define TRACK_SPEED_MAX  255
+#define TRACK_SPEED_SLOW 85
+#define TRACK_SPEED_FAST 255
+// How much the speed can change each SPEED_TASK_PERIOD.
+// 3 takes 0 to full speed in 0.85s, 6 stops from full in 0.43s
+#define TRACK_ACCELERATION 3
+#define TRACK_DECELERATION 6
+
 // How long points can take to change before assuming issue
-// Will check every period, for count periods. 
+// Points are given count periods to confirm before failing. 
+// Defaults, which the console can change (see config.h).
 #define POINT_WAIT_COUNT  100
 #define POINT_WAIT_PERIOD 500
-#define POINT_TRIES 3
+// Point feedback is sampled at most every POINT_FEEDBACK_PERIOD ms
+// and taken as whichever way most of the last POINT_FEEDBACK_SAMPLES
+// (up to 8) samples read, to ride out contact bounce.
+#define POINT_FEEDBACK_PERIOD 10
+#define POINT_FEEDBACK_SAMPLES 7
+
+// Run each train once round at slow speed at start up, so the
+// transit timing (transit_timing.h) learns how its speeds compare.
+// Without it the trains are timed but braking isn't put off.
+#define _CALIBRATION_LAP
+// Percentage of a block (by time at fast speed) to leave for
+// running at slow speed when braking is put off
+#define TRANSIT_BRAKE_MARGIN 25
+// Weight of each new transit time in its moving average,
+// as a power of 2: 3 is 1/8
+#define TRANSIT_AVERAGE_SHIFT 3
+
+// Time in ms to wait after a failed attempt to recover the points
+// before trying again, so a jammed set isn't worked continuously
+#define POINT_RECOVERY_RETRY_INTERVAL 1000
+
+// Time in ms to wait after a failed transition before working
+// out where the trains are and trying again
+#define TRANSITION_RETRY_INTERVAL 1000
 
 // Control for maximum wait time in ms. Actual wait time will be
 // (IN_VOLTS * PLATFORM_DWELL_TIME) / HIGH_VOLTS 
-// Defaults to two minutes 
+// Defaults to two minutes, which the console can change
 #define PLATFORM_DWELL_TIME (2ul*60ul*1000ul)
 
 // Sometimes there's gaps in current detection, so we
-// set a small delay before declaring that we've lost the train
+// set a small delay before declaring that we've lost the train.
+// Each detector starts with this hold-off, then once it has seen
+// SENSOR_FILTER_MIN_PASSES trains go by it uses the longest gap
+// it normally shows (see sensor_filter.h) plus a margin instead,
+// between the min and max. The console can change the starting
+// hold-off, within the same limits.
 #define SENSOR_DEBOUNCE_DELAY 250
+#define SENSOR_HOLDOFF_MIN 20
+#define SENSOR_HOLDOFF_MAX 500
+#define SENSOR_HOLDOFF_MARGIN 20
+#define SENSOR_FILTER_MIN_PASSES 16
+
+// At start up, wait for every input to hold still for
+// SENSOR_READY_PERIOD ms while the IR detectors warm up,
+// but never longer than SENSOR_READY_TIMEOUT ms
+#define SENSOR_READY_PERIOD 500
+#define SENSOR_READY_TIMEOUT 7000
+
+// Number of input edges which can be queued between loops.
+// Must be a power of 2. Each entry costs 6 bytes of RAM.
+#define INPUT_EVENT_BUFFER_SIZE 32
 
 // Array of inputs for ease of setup code
 // New inputs will need to be added here,
-// with an appropriate increment to INPUT_COUNT
+// with an appropriate increment to INPUT_COUNT.
+// New digital inputs go before the analogue ones, with
+// a matching bit in inputs.h.
 static const int input_pins[INPUT_COUNT] = {
   TRAIN_A_IN_PLATFORM_PIN,
   TRAIN_B_IN_PLATFORM_PIN,
@@ -124,27 +196,78 @@ static const int output_pins[OUTPUT_COUNT] = {
   POINT_Y_CONTROL_PIN 
 };
 
-// Debug code. Uncomment the debug define to
-// enable feedback via serial and slow down the 
-// main loop a bit
-#define _SERIAL 1
-#if defined(_SERIAL)
+// Binary event log over serial, see telemetry.h. Cheap enough
+// to leave on; decode it with the host log_decode tool.
+#define _TELEMETRY 1
+
+// RAM for log records waiting to be sent. Must be a power of 2,
+// no more than 256. A record is typically 4-8 bytes.
+#define TELEMETRY_BUFFER_SIZE 128
+
+// Commands over serial to look at and tune the controller while
+// it runs (see console.h). Replies go through the log, so it needs
+// _TELEMETRY.
+#define _CONSOLE 1
+
+// Uncomment to build the settings in config.h in as constants,
+// for a layout which is already tuned: they cost nothing to read,
+// but are no longer loaded from EEPROM or changed by the console.
+//#define _CONFIG_FIXED 1
+
+// Keep the controller's status, point targets and what it has
+// learned in EEPROM (see journal.h), so after a reset it carries
+// on from where it was rather than starting over
+#define _JOURNAL 1
+// Status records in the journal's ring, to spread the EEPROM wear
+#define JOURNAL_SLOTS 64
+// How often what has been learned is saved, if it has changed (ms)
+#define JOURNAL_LEARNED_PERIOD (30ul*60ul*1000ul)
+
+// Count where the time goes (see stats.h): time in each state,
+// point throw times and round trips, dumped to the log every
+// STATS_DUMP_PERIOD ms. Costs about 300 bytes of RAM.
+#define _STATS 1
+#define STATS_DUMP_PERIOD (60ul*60ul*1000ul)
+// Histogram units in ms. Each bucket doubles the one before.
+#define STATS_RESIDENCY_UNIT 100
+#define STATS_POINTS_UNIT    10
+// Log records the dump writes each run of its task, so it
+// doesn't fill the log queue
+#define STATS_DUMP_BATCH 4
+
+// Rates of the tasks run from loop(), as periods in microseconds
+// Captured input edges are handled within this
+#define INPUT_TASK_PERIOD     1000ul
+// Timed state logic (dwell, point throws, retries) and error display
+#define STATE_TASK_PERIOD     10000ul
+// Track speed ramps
+#define SPEED_TASK_PERIOD     10000ul
+// Sending the log
+#define TELEMETRY_TASK_PERIOD 100000ul
+// Writing the journal to EEPROM, a byte at a time
+#define JOURNAL_TASK_PERIOD   5000ul
+// Saving changed settings to EEPROM, a byte at a time
+#define CONFIG_TASK_PERIOD    5000ul
+// Reading console commands. The serial RX buffer holds 64 bytes,
+// which take 67ms to arrive at 9600 baud.
+#define CONSOLE_TASK_PERIOD   20000ul
+// Dumping the statistics, when one is due
+#define STATS_TASK_PERIOD     100000ul
+// Logging the task statistics
+#define TASK_STATS_PERIOD     (60ul*1000ul*1000ul)
+
+// Plain text over serial. Only the benchmarks use this, everything
+// else goes through the binary log.
 #define PRINT(to_print) Serial.print(to_print)
 #define PRINTLN(to_print) Serial.println(to_print)
-#endif
 
-//#define _DEBUG 1
-#if defined(_DEBUG)
-#define DEBUG_PRINT(to_print) Serial.print(to_print)
-#define DEBUG_PRINTLN(to_print) Serial.println(to_print)
-#define DEBUG_DELAY(delay_ms) delay(delay_ms)
-#else
-#define DEBUG_PRINT(to_print)
-#define DEBUG_PRINTLN(to_print)
-#define DEBUG_DELAY(delay_ms)
-#endif
+// Uncomment to have the sketch run the latency benchmarks in
+// benchmark.cpp and print the results, instead of controlling the
+// layout. They drive the outputs, so isolate the layout first.
+// The binary log is stopped while they run.
+//#define _BENCHMARK 1
 
-#if defined(_SERIAL) || defined(_DEBUG)
+#if defined(_TELEMETRY) || defined(_BENCHMARK)
 #define SERIAL_BEGIN(baud) Serial.begin(baud)
 #else
 #define SERIAL_BEGIN(baud)
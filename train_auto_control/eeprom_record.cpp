@@ -0,0 +1,34 @@
+#include "eeprom_record.h"
+
+uint16_t RecordCrc(const uint8_t* data, uint16_t length, uint16_t seed)
+{
+  uint16_t crc = seed;
+  for (uint16_t i = 0; i < length; ++i)
+  {
+    crc ^= static_cast<uint16_t>(data[i]) << 8;
+    for (uint8_t bit = 0; bit < 8; ++bit)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+void SealRecord(uint8_t* record, uint16_t size, uint16_t seed)
+{
+  uint16_t crc = RecordCrc(record, size - 2, seed);
+  record[size - 2] = static_cast<uint8_t>(crc);
+  record[size - 1] = static_cast<uint8_t>(crc >> 8);
+}
+
+bool ReadRecord(uint16_t address, uint8_t* record, uint16_t size, uint16_t seed)
+{
+  for (uint16_t i = 0; i < size; ++i)
+  {
+    record[i] = HalEepromRead(address + i);
+  }
+
+  uint16_t crc = RecordCrc(record, size - 2, seed);
+  return record[size - 2] == static_cast<uint8_t>(crc) &&
+         record[size - 1] == static_cast<uint8_t>(crc >> 8);
+}
\ No newline at end of file
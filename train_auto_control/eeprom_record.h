@@ -0,0 +1,22 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+
+// Records kept in EEPROM (see journal.h and config.h) end with a
+// CRC-16/CCITT of the rest of the record, seeded with the version
+// of the record's layout, so a record torn by the power going, or
+// written by a build which laid it out differently, is ignored.
+
+// CRC-16/CCITT, continuing from seed. Start with RecordSeed.
+uint16_t RecordCrc(const uint8_t* data, uint16_t length, uint16_t seed);
+
+inline uint16_t RecordSeed(uint8_t version) { return 0xFFFF ^ version; }
+
+// Fill in the CRC at the end of a record of size bytes
+void SealRecord(uint8_t* record, uint16_t size, uint16_t seed);
+
+// Read a record of size bytes from address. Returns true if
+// its CRC checks out.
+bool ReadRecord(uint16_t address, uint8_t* record, uint16_t size, uint16_t seed);
\ No newline at end of file
@@ -11,6 +11,23 @@ enum class PointsDirection
   Invalid
 };
 
+// Progress of a set of points being thrown. Points are driven
+// asynchronously and advanced by PollPoints() each loop, so the
+// state machine can keep reading the track sensors while they move.
+// Idle       - no throw has been requested since the last failure
+// Driving    - control output written, waiting for the feedback to agree
+// Confirming - latest feedback sample agrees, waiting for the vote on the samples
+// Done       - feedback has confirmed the target direction
+// Failed     - feedback did not confirm within PointThrowTimeout()
+enum class PointsThrowState
+{
+  Idle,
+  Driving,
+  Confirming,
+  Done,
+  Failed
+};
+
 // Options for controlling the movement of the train. There
 // are 3 outputs for this:
 // Track power, which controls whether the locomotive moves or not
@@ -52,5 +69,100 @@ enum class TrainStatus
   XPointFailure,
   YPointFailure,
   InvalidState,
-  TransitionFailure
+  TransitionFailure,
+  Stopped
+};
+
+// Settings which can be changed while running, see config.h
+enum class ConfigItem
+{
+  PlatformDwellTime,
+  SensorDebounceDelay,
+  PointWaitPeriod,
+  PointWaitCount,
+  PointControlInvert,
+  FeedbackInvert,
+  TrackPower,
+  Forward,
+  TrackFast
+};
+
+// Number of values in TrainStatus, for tables indexed by it
+#define TRAIN_STATUS_COUNT (static_cast<uint8_t>(TrainStatus::Stopped) + 1)
+
+// Outcome of trying to move from the current state to the next.
+// Transitions which need the points thrown stay Pending until
+// the throw completes, and are retried on the next loop.
+enum class TransitionResult
+{
+  Complete,
+  Pending,
+  Failed
+};
+
+// Events in the binary log (see telemetry.h), with their payloads.
+// The values are the log format, so only ever add to the end, and
+// describe new payloads to host/log_decode.cpp.
+enum class LogEventId
+{
+  Boot,                   // TELEMETRY_VERSION
+  Dropped,                // uint16 records lost to a full buffer
+  StateChange,            // TrainStatus from, TrainStatus to
+  TransitionFailed,       // TrainStatus current, TrainStatus next
+  ErrorCode,              // error code on the error pins
+  DwellTime,              // uint16 potentiometer, uint32 dwell in ms
+  TrackPower,             // district, int16 target speed
+  TrackPowerInvalid,      // value passed to TrackPowerSpeed
+  PointsThrow,            // points name, PointsDirection from, PointsDirection to
+  PointsConfirmed,        // points name
+  PointsFailed,           // points name
+  PointsFeedbackInvalid,  // points name, 1 if both feedback inputs active else 0
+  PointsRecoveryStart,    // points name
+  PointsRecoveryWiggle,   // points name
+  PointsRecoveryFailed,   // points name
+  PointsRecovered,        // points name
+  TaskStats,              // task index, uint16 overruns, uint16 max late us, uint16 max run us
+  BlockReserved,          // train, block
+  BlockReleased,          // train, block
+  TrainHeld,              // train, block it was stopped in
+  TrainResumed,           // train, block it was stopped in
+  TransitTime,            // train, block, 0 slow 1 fast 2 braked, uint16 ms
+  BrakePlanned,           // train, block, uint16 ms after entering it
+  CalibrationDone,
+  SensorHoldOff,          // block, uint16 hold-off in ms
+  PointsFeedbackNoise,    // points name, uint16 times the feedback has disagreed
+  SensorsReady,           // uint16 ms to settle, 1 if they never did else 0
+  JournalRestored,        // TrainStatus current, TrainStatus previous, JOURNAL_* flags
+  StatsState,             // TrainStatus, uint16 entries, uint32 total time in 0.1s
+  StatsResidency,         // TrainStatus, bucket, uint16 count
+  StatsPointsLatency,     // points (LAYOUT_POINTS_*), bucket, uint16 count
+  StatsRoundTrips,        // train, uint16 round trips
+  ConsoleAck,             // ConsoleCommand, ConsoleResult
+  ConsoleStatus,          // TrainStatus current, previous, next
+  ConsoleSnapshot,        // uint16 inputs, PointsDirection X, Y feedback
+  ConsoleSpeed,           // district, int16 current speed, int16 target speed
+  ConsoleConfig,          // ConfigItem, uint32 value
+  ConfigLoaded,           // flags (CONFIG_SAVED_FOUND)
+  InputEventsOverflowed   // uint16 edges dropped since start up
+};
+
+// Commands from the serial console, see console.h
+enum class ConsoleCommand
+{
+  Status,
+  Snapshot,
+  Stats,
+  Get,
+  Set,
+  Stop,
+  Resume
+};
+
+// How a console command went, in its ConsoleAck
+enum class ConsoleResult
+{
+  Ok,
+  UnknownCommand,
+  BadArgument,
+  BadFrame
 };
\ No newline at end of file
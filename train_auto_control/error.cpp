@@ -1,33 +1,61 @@
 #include "error.h"
 
+// Write bit Bit of the error and those above it, each to
+// its own pin from ERROR_CODE_BASE
+template <uint8_t Bit>
+static void WriteErrorBits(uint8_t error)
+{
+  Pin<ERROR_CODE_BASE + Bit>::Write((error >> Bit) & 1);
+  WriteErrorBits<Bit + 1>(error);
+}
+
+template <>
+void WriteErrorBits<ERROR_CODE_BITS>(uint8_t)
+{
+}
+
 // Write the error state to the output bits
 // 0 is no error.
 void WriteError(uint8_t error)
 {
-  for (int i = 0; i < ERROR_CODE_BITS; ++i)
-  {
-    digitalWrite(ERROR_CODE_BASE + i, (error >> i) & 1);
-  }
+  WriteErrorBits<0>(error);
 }
 
 // Calculate the error code for output. If state is 
 // < TrainErrorBase then there is no error and output
 // 0
 // If state is >= TrainErrorBase then there is an error
-// which should be state - TrainErrorBase.
+// which should be state - TrainErrorBase. Errors are
+// shown flashing, ERROR_BLINK_ON_TIME on and then
+// ERROR_BLINK_OFF_TIME off, starting with the code shown
+// so a new error appears straight away.
+// Changes of error code are logged.
 void WriteError()
 {
+  static uint8_t lastError = 0;
+  static bool shown = true;
+  static uint32_t blinkStart = 0;
+
   uint8_t error = 0;
   if (g_currentStatus >= TrainStatus::TrainErrorBase)
   {
-    PRINT("Error: "); PRINTLN(StateToString(g_currentStatus));
     error = static_cast<uint8_t>(g_currentStatus) - static_cast<uint8_t>(TrainStatus::TrainErrorBase);
   }
 
-  WriteError(error);
+  uint32_t now = HalMillis();
 
-  if (g_currentStatus >= TrainStatus::TrainErrorBase)
+  if (error != lastError)
   {
-    delay(1000);
+    LogEvent(LogEventId::ErrorCode, error);
+    lastError = error;
+    shown = true;
+    blinkStart = now;
   }
+  else if (now - blinkStart >= (shown ? ERROR_BLINK_ON_TIME : ERROR_BLINK_OFF_TIME))
+  {
+    shown = !shown;
+    blinkStart = now;
+  }
+
+  WriteError(shown ? error : 0);
 }
\ No newline at end of file
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <Arduino.h>
+#include "hal.h"
 #include "defines.h"
 #include "state_control.h"
 
@@ -0,0 +1,243 @@
+#pragma once
+
+// Thin hardware abstraction layer. All of the controller logic
+// talks to the hardware through these calls rather than the
+// Arduino core directly, so the same sources can be built for
+// the host (see host/) to profile, test and simulate them.
+// On the Arduino these are inline forwards to the core, so
+// they cost nothing over calling it directly.
+
+#include <stdint.h>
+
+// How the Nano's pins are laid out over the ATmega328P's ports:
+// 0-7 are PORTD, 8-13 PORTB and 14-19 (A0-A5) PORTC
+#define HAL_PORT_D 0
+#define HAL_PORT_B 1
+#define HAL_PORT_C 2
+#define HAL_PORT_COUNT 3
+constexpr uint8_t HalPinPort(uint8_t pin) { return pin < 8 ? HAL_PORT_D : pin < 14 ? HAL_PORT_B : HAL_PORT_C; }
+constexpr uint8_t HalPinBit(uint8_t pin) { return pin < 8 ? pin : pin < 14 ? pin - 8 : pin - 14; }
+constexpr uint8_t HalPortFirstPin(uint8_t port) { return port == HAL_PORT_D ? 0 : port == HAL_PORT_B ? 8 : 14; }
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+
+inline void HalPinMode(uint8_t pin, uint8_t mode) { pinMode(pin, mode); }
+inline uint8_t HalDigitalRead(uint8_t pin) { return digitalRead(pin); }
+inline void HalDigitalWrite(uint8_t pin, uint8_t value) { digitalWrite(pin, value); }
+inline uint16_t HalAnalogRead(uint8_t pin) { return analogRead(pin); }
+inline uint32_t HalMillis() { return millis(); }
+inline uint32_t HalMicros() { return micros(); }
+inline void HalDelay(uint32_t ms) { delay(ms); }
+
+// Pin N, known when building (the *_PIN defines). On the
+// ATmega328P it resolves to a port register and bit, so each Write
+// compiles to an sbi or cbi, picked by the value, and each Read to
+// an in, where digitalWrite goes through the core's lookup tables
+// for around 50 cycles. With a constant value the branch goes too.
+// Unlike digitalWrite it doesn't turn off a hardware PWM on the
+// pin, so don't use it on pins driven with analogWrite.
+#if defined(__AVR_ATmega328P__)
+template <uint8_t N>
+struct Pin
+{
+  static_assert(N < 20, "Pin<N> only covers the ATmega328P's digital pins, 0-19");
+
+  static constexpr uint8_t Mask = _BV(HalPinBit(N));
+  static volatile uint8_t& Output() { return N < 8 ? PORTD : N < 14 ? PORTB : PORTC; }
+  static volatile uint8_t& Input() { return N < 8 ? PIND : N < 14 ? PINB : PINC; }
+
+  static void Write(uint8_t value)
+  {
+    if (value)
+    {
+      Output() |= Mask;
+    }
+    else
+    {
+      Output() &= ~Mask;
+    }
+  }
+  static uint8_t Read() { return (Input() & Mask) ? HIGH : LOW; }
+};
+
+// Set the bits in mask of a port (HAL_PORT_*) to their levels in
+// levels, in one write. Interrupts are held off for it, as the
+// software PWM writes the same ports.
+inline void HalWritePort(uint8_t port, uint8_t mask, uint8_t levels)
+{
+  volatile uint8_t& output = port == HAL_PORT_D ? PORTD : port == HAL_PORT_B ? PORTB : PORTC;
+  uint8_t sreg = SREG;
+  cli();
+  output = (output & ~mask) | (levels & mask);
+  SREG = sreg;
+}
+#else
+// Other boards go through the core
+template <uint8_t N>
+struct Pin
+{
+  static void Write(uint8_t value) { digitalWrite(N, value); }
+  static uint8_t Read() { return digitalRead(N); }
+};
+
+inline void HalWritePort(uint8_t port, uint8_t mask, uint8_t levels)
+{
+  for (uint8_t bit = 0; bit < 8; ++bit)
+  {
+    if (mask & (1u << bit))
+    {
+      digitalWrite(HalPortFirstPin(port) + bit, (levels >> bit) & 1);
+    }
+  }
+}
+#endif
+
+// Enable the pin change interrupt for a pin, clearing anything
+// already pending for its port. The PCINTn_vect handlers belong
+// to the code using them (see input_events.cpp).
+inline void HalEnablePinChange(uint8_t pin)
+{
+  *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+  PCIFR = _BV(digitalPinToPCICRbit(pin));
+  *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+}
+
+// Byte access to the on chip EEPROM. A write takes about 3.3ms
+// to complete, during which the EEPROM can't be used, so only
+// write when HalEepromReady or it waits for the last write.
+#define HAL_EEPROM_SIZE (E2END + 1)
+inline uint8_t HalEepromRead(uint16_t address)
+{
+  return eeprom_read_byte(reinterpret_cast<const uint8_t*>(address));
+}
+inline void HalEepromWrite(uint16_t address, uint8_t value)
+{
+  eeprom_write_byte(reinterpret_cast<uint8_t*>(address), value);
+}
+inline bool HalEepromReady() { return eeprom_is_ready(); }
+
+// Software PWM from TIMER2 (see hal_pwm.cpp), as the pins with
+// hardware PWM are all in use. Duty is out of 255; 0 is held low
+// and 255 held high. Once a pin has been written with this, set it
+// with this rather than HalDigitalWrite.
+void HalPwmWrite(uint8_t pin, uint8_t duty);
+
+// Cycle counter on TIMER1 for timing short sections of code.
+// Counts CPU cycles from the last reset and saturates at 0xFFFF
+// (4ms at 16MHz). Takes over TIMER1, so no PWM on pins 9 and 10.
+#define HAL_COUNTER_TICKS_PER_US (F_CPU / 1000000UL)
+inline void HalResetCycleCounter()
+{
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1);
+}
+inline uint32_t HalReadCycleCounter()
+{
+  uint16_t count = TCNT1;
+  return (TIFR1 & _BV(TOV1)) ? 0xFFFF : count;
+}
+
+#else
+
+// Pin names, pin modes and the Serial stand in for the host build
+#include "hal_host.h"
+
+void HalPinMode(uint8_t pin, uint8_t mode);
+uint8_t HalDigitalRead(uint8_t pin);
+void HalDigitalWrite(uint8_t pin, uint8_t value);
+uint16_t HalAnalogRead(uint8_t pin);
+uint32_t HalMillis();
+uint32_t HalMicros();
+void HalDelay(uint32_t ms);
+void HalPwmWrite(uint8_t pin, uint8_t duty);
+
+// Same interface as the Arduino's, through the host pins
+template <uint8_t N>
+struct Pin
+{
+  static void Write(uint8_t value) { HalDigitalWrite(N, value); }
+  static uint8_t Read() { return HalDigitalRead(N); }
+};
+// A pin at a time, but all at the same instant of host time
+void HalWritePort(uint8_t port, uint8_t mask, uint8_t levels);
+// Changes to enabled pins call the handler set with
+// HostSetPinChangeHandler, in place of the interrupt
+void HalEnablePinChange(uint8_t pin);
+
+// EEPROM the size of the ATmega328P's, held in RAM (see
+// HostEeprom). Writes complete straight away.
+#define HAL_EEPROM_SIZE 1024
+uint8_t HalEepromRead(uint16_t address);
+void HalEepromWrite(uint16_t address, uint8_t value);
+bool HalEepromReady();
+
+// Nanoseconds since the last reset on the host
+#define HAL_COUNTER_TICKS_PER_US 1000UL
+void HalResetCycleCounter();
+uint32_t HalReadCycleCounter();
+
+#endif
+
+// A pin held in a table, such as the layout's districts, with
+// its port and bit worked out when building, for HalOutputShadow
+struct HalPin
+{
+  uint8_t number;
+  uint8_t port;
+  uint8_t mask;
+};
+
+#define HAL_PIN(n) { n, HalPinPort(n), static_cast<uint8_t>(1u << HalPinBit(n)) }
+
+// Output levels set one at a time and then written together, one
+// port write per port, for outputs which must change together so
+// nothing they drive sees a mix of old and new. Remembers what it
+// last wrote, so outputs already at their level aren't written.
+// Only the pins given to Set are touched, and nothing else should
+// write them.
+class HalOutputShadow
+{
+public:
+  // The level a pin is to have at the next Commit
+  void Set(const HalPin& pin, uint8_t value)
+  {
+    if (value)
+    {
+      m_levels[pin.port] |= pin.mask;
+    }
+    else
+    {
+      m_levels[pin.port] &= ~pin.mask;
+    }
+    m_used[pin.port] |= pin.mask;
+  }
+
+  // Write every level which differs from the last written, or
+  // hasn't been written yet
+  void Commit()
+  {
+    for (uint8_t port = 0; port < HAL_PORT_COUNT; ++port)
+    {
+      uint8_t changed = ((m_levels[port] ^ m_written[port]) | ~m_known[port]) & m_used[port];
+      if (changed)
+      {
+        HalWritePort(port, changed, m_levels[port]);
+        m_written[port] = m_levels[port];
+        m_known[port] = m_used[port];
+      }
+    }
+  }
+
+private:
+  // Levels to write, pins which have been Set, the levels last
+  // written and which of those pins they cover, by HAL_PORT_*
+  uint8_t m_levels[HAL_PORT_COUNT] = {};
+  uint8_t m_used[HAL_PORT_COUNT] = {};
+  uint8_t m_written[HAL_PORT_COUNT] = {};
+  uint8_t m_known[HAL_PORT_COUNT] = {};
+};
@@ -0,0 +1,86 @@
+#include "hal.h"
+
+// Software PWM for the Arduino (see HalPwmWrite in hal.h). The host
+// build has its own HalPwmWrite, which just records the duty.
+#if defined(ARDUINO)
+
+// Most pins which can be driven at once
+#define HAL_PWM_CHANNELS 4
+// TIMER2 interrupt rate. The phase steps by HAL_PWM_STEP each
+// interrupt, so the period is 256 / HAL_PWM_STEP interrupts
+// (32, or 125Hz) and the duty has that many levels.
+#define HAL_PWM_TICK_HZ 4000
+#define HAL_PWM_STEP 8
+
+struct PwmChannel
+{
+  uint8_t pin;
+  volatile uint8_t* port;
+  uint8_t mask;
+  volatile uint8_t duty;
+};
+
+static PwmChannel s_channels[HAL_PWM_CHANNELS];
+static volatile uint8_t s_channelCount = 0;
+static uint8_t s_phase = 0;
+
+ISR(TIMER2_COMPA_vect)
+{
+  s_phase += HAL_PWM_STEP;
+  for (uint8_t i = 0; i < s_channelCount; ++i)
+  {
+    PwmChannel& channel = s_channels[i];
+    if (channel.duty > s_phase)
+    {
+      *channel.port |= channel.mask;
+    }
+    else
+    {
+      *channel.port &= ~channel.mask;
+    }
+  }
+}
+
+// TIMER2 in CTC mode, clocked at F_CPU / 32
+static void StartPwmTimer()
+{
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS21) | _BV(CS20);
+  OCR2A = F_CPU / 32 / HAL_PWM_TICK_HZ - 1;
+  TIMSK2 |= _BV(OCIE2A);
+}
+
+// The first write to a pin gives it a channel
+void HalPwmWrite(uint8_t pin, uint8_t duty)
+{
+  for (uint8_t i = 0; i < s_channelCount; ++i)
+  {
+    if (s_channels[i].pin == pin)
+    {
+      s_channels[i].duty = duty;
+      return;
+    }
+  }
+
+  if (s_channelCount == HAL_PWM_CHANNELS)
+  {
+    // Out of channels, so the best that can be done
+    digitalWrite(pin, duty >= 128 ? HIGH : LOW);
+    return;
+  }
+
+  PwmChannel& channel = s_channels[s_channelCount];
+  channel.pin = pin;
+  channel.port = portOutputRegister(digitalPinToPort(pin));
+  channel.mask = digitalPinToBitMask(pin);
+  channel.duty = duty;
+
+  // The interrupt only looks at channels below the count,
+  // so the new one is complete before it's included
+  if (++s_channelCount == 1)
+  {
+    StartPwmTimer();
+  }
+}
+
+#endif
\ No newline at end of file
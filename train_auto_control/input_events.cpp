@@ -0,0 +1,129 @@
+#include "input_events.h"
+
+#if (INPUT_EVENT_BUFFER_SIZE & (INPUT_EVENT_BUFFER_SIZE - 1)) != 0
+#error INPUT_EVENT_BUFFER_SIZE must be a power of 2
+#endif
+
+#define INPUT_EVENT_INDEX_MASK (INPUT_EVENT_BUFFER_SIZE - 1)
+
+// Single producer (the interrupt), single consumer (the loop) ring
+// buffer. Only the producer writes s_head and only the consumer
+// writes s_tail, and both are single bytes, so neither side needs
+// interrupts disabled. A slot is written before s_head moves past
+// it and read before s_tail does, so they never touch the same one.
+static volatile InputEvent s_events[INPUT_EVENT_BUFFER_SIZE];
+static volatile uint8_t s_head = 0;
+static volatile uint8_t s_tail = 0;
+
+// Set by the producer when it has dropped an edge, and the
+// number it has dropped since start up
+static volatile bool s_overflowed = false;
+static volatile uint16_t s_overflows = 0;
+
+// Inputs as of the last edge, to ignore interrupts for pins
+// which aren't ours or which changed back before we got there.
+// Only touched by the producer once set up.
+static InputSnapshot s_lastCaptured = 0;
+
+// Record the current state of the inputs if it has changed.
+// Called from the pin change interrupts, so must be quick.
+void CaptureInputEdge()
+{
+  uint32_t now = HalMicros();
+  InputSnapshot inputs = TakeInputSnapshot();
+  if (inputs == s_lastCaptured)
+  {
+    return;
+  }
+  s_lastCaptured = inputs;
+
+  uint8_t head = s_head;
+  uint8_t nextHead = (head + 1) & INPUT_EVENT_INDEX_MASK;
+  if (nextHead == s_tail)
+  {
+    s_overflowed = true;
+    ++s_overflows;
+    return;
+  }
+
+  s_events[head].micros = now;
+  s_events[head].inputs = inputs;
+  s_head = nextHead;
+}
+
+#if defined(__AVR__)
+// The inputs span all three ports, each with its own vector
+ISR(PCINT0_vect) { CaptureInputEdge(); }
+ISR(PCINT1_vect) { CaptureInputEdge(); }
+ISR(PCINT2_vect) { CaptureInputEdge(); }
+#endif
+
+// Take the starting state of the inputs and enable the pin
+// change interrupt for each digital input. Must be called
+// after SetupInputSnapshot.
+void SetupInputEvents()
+{
+  s_head = 0;
+  s_tail = 0;
+  s_overflowed = false;
+  s_lastCaptured = TakeInputSnapshot();
+
+  g_inputs = s_lastCaptured;
+  g_inputsMicros = HalMicros();
+
+#if !defined(ARDUINO)
+  HostSetPinChangeHandler(CaptureInputEdge);
+#endif
+
+  for (uint8_t i = 0; i < DIGITAL_INPUT_COUNT; ++i)
+  {
+    HalEnablePinChange(input_pins[i]);
+  }
+}
+
+// The producer's count of dropped edges. It's two bytes, so on
+// the AVR interrupts are held off to read it in one piece.
+static uint16_t ReadOverflows()
+{
+#if defined(__AVR__)
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t overflows = s_overflows;
+  SREG = sreg;
+  return overflows;
+#else
+  return s_overflows;
+#endif
+}
+
+// Take the oldest edge from the buffer. Returns false once
+// there are none left. If edges were dropped, the last event
+// returned is the state of the pins now, so the consumer still
+// ends up in step with the layout, and the drop is logged.
+bool NextInputEvent(InputEvent& event)
+{
+  uint8_t tail = s_tail;
+  if (tail == s_head)
+  {
+    if (!s_overflowed)
+    {
+      return false;
+    }
+
+    s_overflowed = false;
+    uint16_t overflows = ReadOverflows();
+    uint8_t payload[] = {
+      static_cast<uint8_t>(overflows),
+      static_cast<uint8_t>(overflows >> 8)
+    };
+    LogEvent(LogEventId::InputEventsOverflowed, payload, sizeof(payload));
+    event.micros = HalMicros();
+    event.inputs = TakeInputSnapshot();
+    return true;
+  }
+
+  event.micros = s_events[tail].micros;
+  event.inputs = s_events[tail].inputs;
+  s_tail = (tail + 1) & INPUT_EVENT_INDEX_MASK;
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+#include "inputs.h"
+#include "telemetry.h"
+
+// Every change of the digital inputs is captured by the pin change
+// interrupts as it happens and queued here with its time, so the
+// state machine sees each one in order even if the loop was busy
+// (waiting on points, showing an error) when it happened.
+struct InputEvent
+{
+  uint32_t micros;      // HalMicros() when the edge was seen
+  InputSnapshot inputs; // All of the inputs just after the edge
+};
+
+void SetupInputEvents();
+void CaptureInputEdge();
+bool NextInputEvent(InputEvent& event);
\ No newline at end of file
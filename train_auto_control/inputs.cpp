@@ -0,0 +1,139 @@
+#include "inputs.h"
+#include "config.h"
+#include "telemetry.h"
+
+// Snapshot of the inputs for the current loop
+InputSnapshot g_inputs;
+uint32_t g_inputsMicros;
+
+// Bits which are active when the pin reads low. The track
+// sensors are all active low, the point feedback depends on
+// g_config.feedbackInvert.
+static constexpr InputSnapshot ActiveLowMask(uint8_t feedbackInvert)
+{
+  return INPUT_TRAIN_A_IN_PLATFORM |
+         INPUT_TRAIN_B_IN_PLATFORM |
+         INPUT_TRAIN_ON_LINE |
+         INPUT_TRAIN_ON_SLOW_X |
+         INPUT_TRAIN_ON_SLOW_Y |
+         ((feedbackInvert & CONFIG_FEEDBACK_X_PLAT_A) ? INPUT_POINT_X_PLAT_A_FEEDBACK : 0) |
+         ((feedbackInvert & CONFIG_FEEDBACK_X_PLAT_B) ? INPUT_POINT_X_PLAT_B_FEEDBACK : 0) |
+         ((feedbackInvert & CONFIG_FEEDBACK_Y_PLAT_A) ? INPUT_POINT_Y_PLAT_A_FEEDBACK : 0) |
+         ((feedbackInvert & CONFIG_FEEDBACK_Y_PLAT_B) ? INPUT_POINT_Y_PLAT_B_FEEDBACK : 0);
+}
+
+#if defined(_CONFIG_FIXED)
+static const InputSnapshot s_activeLowMask = ActiveLowMask(g_config.feedbackInvert);
+#else
+// Polarities only change at reset, so this is worked out in setup
+static InputSnapshot s_activeLowMask;
+#endif
+
+#if defined(__AVR__)
+// Each distinct input port register, and which of them
+// (and which bit) each input lives on. Built once in setup
+// so sampling is a handful of direct register reads.
+static volatile uint8_t* s_portRegisters[DIGITAL_INPUT_COUNT];
+static uint8_t s_portCount = 0;
+static uint8_t s_inputPort[DIGITAL_INPUT_COUNT];
+static uint8_t s_inputMask[DIGITAL_INPUT_COUNT];
+#endif
+
+// Look up the port registers for the digital inputs.
+// Must be called after the pin modes have been set and
+// the config loaded.
+void SetupInputSnapshot()
+{
+#if !defined(_CONFIG_FIXED)
+  s_activeLowMask = ActiveLowMask(g_config.feedbackInvert);
+#endif
+
+#if defined(__AVR__)
+  for (uint8_t i = 0; i < DIGITAL_INPUT_COUNT; ++i)
+  {
+    volatile uint8_t* portRegister = portInputRegister(digitalPinToPort(input_pins[i]));
+
+    uint8_t port = 0;
+    while (port < s_portCount && s_portRegisters[port] != portRegister)
+    {
+      ++port;
+    }
+
+    if (port == s_portCount)
+    {
+      s_portRegisters[s_portCount++] = portRegister;
+    }
+
+    s_inputPort[i] = port;
+    s_inputMask[i] = digitalPinToBitMask(input_pins[i]);
+  }
+#endif
+}
+
+// Sample all of the digital inputs. On AVR every port is
+// read back to back before any decoding, so the snapshot is
+// as close to a single instant as the hardware allows.
+InputSnapshot TakeInputSnapshot()
+{
+  InputSnapshot raw = 0;
+
+#if defined(__AVR__)
+  uint8_t portValues[DIGITAL_INPUT_COUNT];
+  for (uint8_t port = 0; port < s_portCount; ++port)
+  {
+    portValues[port] = *s_portRegisters[port];
+  }
+
+  for (uint8_t i = 0; i < DIGITAL_INPUT_COUNT; ++i)
+  {
+    if (portValues[s_inputPort[i]] & s_inputMask[i])
+    {
+      raw |= 1u << i;
+    }
+  }
+#else
+  for (uint8_t i = 0; i < DIGITAL_INPUT_COUNT; ++i)
+  {
+    if (HalDigitalRead(input_pins[i]))
+    {
+      raw |= 1u << i;
+    }
+  }
+#endif
+
+  return raw ^ s_activeLowMask;
+}
+
+
+// Wait for the sensors to settle after power up, until every
+// digital input has held still for SENSOR_READY_PERIOD or
+// SENSOR_READY_TIMEOUT has passed. Logs and returns how long
+// it took in ms.
+uint16_t WaitForStableInputs()
+{
+  uint32_t start = HalMillis();
+  uint32_t now = start;
+  uint32_t stableSince = start;
+  InputSnapshot last = TakeInputSnapshot();
+
+  while (now - stableSince < SENSOR_READY_PERIOD && now - start < SENSOR_READY_TIMEOUT)
+  {
+    HalDelay(1);
+    now = HalMillis();
+
+    InputSnapshot inputs = TakeInputSnapshot();
+    if (inputs != last)
+    {
+      last = inputs;
+      stableSince = now;
+    }
+  }
+
+  uint16_t elapsed = now - start;
+  bool settled = now - stableSince >= SENSOR_READY_PERIOD;
+  uint8_t payload[] = {
+    static_cast<uint8_t>(elapsed), static_cast<uint8_t>(elapsed >> 8), static_cast<uint8_t>(!settled)
+  };
+  LogEvent(LogEventId::SensorsReady, payload, sizeof(payload));
+  return elapsed;
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+
+// One bit per digital input, set when that input is active
+// (active low sensors and the feedback polarities in config.h
+// are already applied). Sampled once per loop so every decision
+// in a pass sees the layout at the same instant.
+typedef uint16_t InputSnapshot;
+
+// Bit for each entry of input_pins[], in the same order
+#define INPUT_TRAIN_A_IN_PLATFORM      (1u << 0)
+#define INPUT_TRAIN_B_IN_PLATFORM      (1u << 1)
+#define INPUT_TRAIN_ON_LINE            (1u << 2)
+#define INPUT_TRAIN_ON_SLOW_X          (1u << 3)
+#define INPUT_TRAIN_ON_SLOW_Y          (1u << 4)
+#define INPUT_POINT_X_PLAT_A_FEEDBACK  (1u << 5)
+#define INPUT_POINT_X_PLAT_B_FEEDBACK  (1u << 6)
+#define INPUT_POINT_Y_PLAT_A_FEEDBACK  (1u << 7)
+#define INPUT_POINT_Y_PLAT_B_FEEDBACK  (1u << 8)
+
+void SetupInputSnapshot();
+InputSnapshot TakeInputSnapshot();
+uint16_t WaitForStableInputs();
+
+extern InputSnapshot g_inputs;
+// HalMicros() when the inputs in g_inputs were seen
+extern uint32_t g_inputsMicros;
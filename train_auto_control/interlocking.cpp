@@ -0,0 +1,432 @@
+#include "interlocking.h"
+
+static_assert(LAYOUT_TRAIN_COUNT < NO_TRAIN, "Too many trains");
+static_assert(LAYOUT_DISTRICT_COUNT <= 8, "Too many districts for a district mask");
+
+// How far a train has got round its route (TrainRoute), as
+// indexes into route.blocks. It holds every block from tail to
+// reserved: tail to head are the blocks it's in, the rest are
+// reserved ahead of it.
+struct TrainProgress
+{
+  uint8_t tail;
+  uint8_t head;
+  uint8_t reserved;
+  // Running its route, rather than standing at home
+  bool active;
+  // Stopped by the interlocking for want of a block ahead
+  bool held;
+  // Track power the state machine asked for
+  TrackPowerState power;
+};
+
+static uint8_t s_blockOwner[LAYOUT_BLOCK_COUNT];
+static TrainProgress s_trains[LAYOUT_TRAIN_COUNT];
+
+static void ReserveBlock(uint8_t train, BlockIndex block)
+{
+  if (s_blockOwner[block] != train)
+  {
+    s_blockOwner[block] = train;
+    LogEvent(LogEventId::BlockReserved, train, block);
+  }
+}
+
+static void ReleaseBlock(uint8_t train, BlockIndex block)
+{
+  if (s_blockOwner[block] == train)
+  {
+    s_blockOwner[block] = NO_TRAIN;
+    LogEvent(LogEventId::BlockReleased, train, block);
+  }
+}
+
+static uint8_t DistrictBit(BlockIndex block)
+{
+  return 1 << s_layoutBlocks[block].district;
+}
+
+// The districts of every block the train holds
+static uint8_t TrainDistricts(uint8_t train)
+{
+  const TrainProgress& progress = s_trains[train];
+  const Route& route = TrainRoute(train);
+  uint8_t districts = 0;
+  for (uint8_t i = progress.tail; i <= progress.reserved; ++i)
+  {
+    districts |= DistrictBit(route.blocks[i]);
+  }
+  return districts;
+}
+
+static void ApplyPower(uint8_t districts, TrackPowerState power)
+{
+  for (uint8_t district = 0; district < LAYOUT_DISTRICT_COUNT; ++district)
+  {
+    if (districts & (1 << district))
+    {
+      SetDistrictPowerState(district, TrackPowerSpeed(power));
+    }
+  }
+}
+
+// Stop without waiting for the ramp, as the train
+// must not run on into the next block
+static void StopDistricts(uint8_t districts)
+{
+  for (uint8_t district = 0; district < LAYOUT_DISTRICT_COUNT; ++district)
+  {
+    if (districts & (1 << district))
+    {
+      StopDistrict(district);
+    }
+  }
+}
+
+// Returns true if another train which is moving holds a block in
+// the district. A district has one power supply, so only one train
+// in it can move at a time.
+static bool DistrictInUse(uint8_t train, BlockIndex block)
+{
+  uint8_t district = DistrictBit(block);
+  for (BlockIndex other = 0; other < LAYOUT_BLOCK_COUNT; ++other)
+  {
+    uint8_t owner = s_blockOwner[other];
+    if (owner != NO_TRAIN && owner != train &&
+        s_trains[owner].power != TrackPowerState::Stop &&
+        DistrictBit(other) == district)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns true if another train needs the points set the other
+// way, for the part of its route it's on or has reserved
+static bool PointsLocked(uint8_t train, uint8_t points, PointsDirection setting)
+{
+  for (uint8_t other = 0; other < LAYOUT_TRAIN_COUNT; ++other)
+  {
+    const TrainProgress& progress = s_trains[other];
+    if (other == train || !progress.active)
+    {
+      continue;
+    }
+
+    const Route& route = TrainRoute(other);
+    for (uint8_t i = progress.tail; i < progress.reserved; ++i)
+    {
+      const LinkDef& link = s_layoutLinks[route.links[i]];
+      if (link.points == points && link.setting != setting)
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Returns true if the train still needs the block further on, as
+// on a loop which comes back to where it started
+static bool BlockHeldAhead(uint8_t train, BlockIndex block)
+{
+  const TrainProgress& progress = s_trains[train];
+  const Route& route = TrainRoute(train);
+  for (uint8_t i = progress.tail; i <= progress.reserved; ++i)
+  {
+    if (route.blocks[i] == block)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reserve blocks along the route up to INTERLOCKING_LOOKAHEAD
+// beyond the train, stopping at the first it can't have.
+// Returns true if any were added.
+static bool ExtendReservation(uint8_t train)
+{
+  TrainProgress& progress = s_trains[train];
+  const Route& route = TrainRoute(train);
+  bool extended = false;
+
+  while (progress.reserved + 1 < route.length &&
+         progress.reserved - progress.head < INTERLOCKING_LOOKAHEAD)
+  {
+    BlockIndex next = route.blocks[progress.reserved + 1];
+    const LinkDef& link = s_layoutLinks[route.links[progress.reserved]];
+    uint8_t owner = s_blockOwner[next];
+
+    if ((owner != NO_TRAIN && owner != train) ||
+        DistrictInUse(train, next) ||
+        (link.points != NO_POINTS && PointsLocked(train, link.points, link.setting)))
+    {
+      break;
+    }
+
+    ReserveBlock(train, next);
+    ++progress.reserved;
+    extended = true;
+  }
+
+  return extended;
+}
+
+// Set the points for the blocks reserved ahead of the train
+static PointsThrowState SetReservedPoints(uint8_t train)
+{
+  const TrainProgress& progress = s_trains[train];
+  const Route& route = TrainRoute(train);
+
+  PointsDirection settings[LAYOUT_POINTS_COUNT];
+  for (uint8_t points = 0; points < LAYOUT_POINTS_COUNT; ++points)
+  {
+    settings[points] = PointsDirection::Invalid;
+  }
+
+  for (uint8_t i = progress.head; i < progress.reserved; ++i)
+  {
+    const LinkDef& link = s_layoutLinks[route.links[i]];
+    if (link.points != NO_POINTS)
+    {
+      settings[link.points] = link.setting;
+    }
+  }
+
+  return SetPoints(settings);
+}
+
+// Returns true if the train may run on into the next block of its
+// route: it holds the block, and any points into it have confirmed.
+// At the end of its route stopping is up to the state machine.
+static bool HasAuthority(uint8_t train)
+{
+  const TrainProgress& progress = s_trains[train];
+  const Route& route = TrainRoute(train);
+
+  if (progress.head + 1 >= route.length)
+  {
+    return true;
+  }
+
+  if (progress.reserved == progress.head)
+  {
+    return false;
+  }
+
+  const LinkDef& link = s_layoutLinks[route.links[progress.head]];
+  return link.points == NO_POINTS || PointsConfirmed(link.points, link.setting);
+}
+
+// Release everything the train holds
+static void ReleaseTrain(uint8_t train)
+{
+  for (BlockIndex block = 0; block < LAYOUT_BLOCK_COUNT; ++block)
+  {
+    ReleaseBlock(train, block);
+  }
+}
+
+// Every train standing at home, holding only its home block
+void ResetInterlocking()
+{
+  for (uint8_t train = 0; train < LAYOUT_TRAIN_COUNT; ++train)
+  {
+    const Route& route = TrainRoute(train);
+    for (BlockIndex block = 0; block < LAYOUT_BLOCK_COUNT; ++block)
+    {
+      if (route.length == 0 || block != route.blocks[0])
+      {
+        ReleaseBlock(train, block);
+      }
+    }
+
+    s_trains[train] = { 0, 0, 0, false, false, TrackPowerState::Stop };
+    TrainPowerChanged(train, TrackPowerState::Stop);
+  }
+
+  for (uint8_t train = 0; train < LAYOUT_TRAIN_COUNT; ++train)
+  {
+    const Route& route = TrainRoute(train);
+    if (route.length > 0)
+    {
+      ReserveBlock(train, route.blocks[0]);
+    }
+  }
+}
+
+// Call after SetupLayout, which finds the routes
+void SetupInterlocking()
+{
+  for (BlockIndex block = 0; block < LAYOUT_BLOCK_COUNT; ++block)
+  {
+    s_blockOwner[block] = NO_TRAIN;
+  }
+
+  ResetInterlocking();
+}
+
+// Follow each running train along its route from the block
+// occupancy: move its head on as the next block's detector sees
+// it, release blocks behind it as theirs clear, reserve more ahead
+// and hold it if it has run out. Call after UpdateOccupancy and
+// PollPoints.
+void UpdateInterlocking()
+{
+  for (uint8_t train = 0; train < LAYOUT_TRAIN_COUNT; ++train)
+  {
+    TrainProgress& progress = s_trains[train];
+    const Route& route = TrainRoute(train);
+    if (!progress.active)
+    {
+      continue;
+    }
+
+    // Only a train with power can have moved on, which keeps a
+    // block seen through a shared feed from being taken for it
+    bool moving = progress.power != TrackPowerState::Stop;
+    if (moving && progress.head < progress.reserved &&
+        BlockOccupied(route.blocks[progress.head + 1]))
+    {
+      ++progress.head;
+      TrainEnteredBlock(train, route.blocks[progress.head]);
+    }
+
+    uint8_t districts = TrainDistricts(train);
+
+    // Once stopped at the end of its route the train is all in
+    // the last block. The detector behind it may share a feed
+    // with that block (see layout_config.h) and never clear.
+    bool arrived = !moving && progress.head + 1 == route.length;
+
+    while (progress.tail < progress.head &&
+           (arrived || !BlockOccupied(route.blocks[progress.tail])))
+    {
+      BlockIndex block = route.blocks[progress.tail++];
+      if (!BlockHeldAhead(train, block))
+      {
+        ReleaseBlock(train, block);
+      }
+    }
+
+    if (progress.tail == progress.head && progress.head + 1 == route.length)
+    {
+      // Home again, which is where the route starts
+      progress.tail = 0;
+      progress.head = 0;
+      progress.reserved = 0;
+      progress.active = false;
+      continue;
+    }
+
+    bool extended = ExtendReservation(train);
+    if (extended || progress.held)
+    {
+      // Retries failed points while held
+      SetReservedPoints(train);
+    }
+
+    uint8_t heldDistricts = TrainDistricts(train);
+    if (moving && !progress.held)
+    {
+      // Power follows the train into new districts, and
+      // is cut in those it has left
+      ApplyPower(heldDistricts & ~districts, progress.power);
+      ApplyPower(districts & ~heldDistricts, TrackPowerState::Stop);
+    }
+
+    bool authority = HasAuthority(train);
+    if (moving && authority == progress.held)
+    {
+      progress.held = !authority;
+      LogEvent(progress.held ? LogEventId::TrainHeld : LogEventId::TrainResumed,
+               train, route.blocks[progress.head]);
+      if (progress.held)
+      {
+        StopDistricts(heldDistricts);
+        TrainPowerChanged(train, TrackPowerState::Stop);
+      }
+      else
+      {
+        ApplyPower(heldDistricts, progress.power);
+        TrainPowerChanged(train, progress.power);
+      }
+    }
+  }
+}
+
+// Reserve the train's route onwards from the given block, which
+// it's in, and set the points for it. Moves the train there first
+// if it isn't already, releasing whatever it held. Call again each
+// loop until it returns Done; returns Idle while waiting for
+// another train to clear the way and Failed if the block is
+// held by another train, isn't on the route or the points failed.
+PointsThrowState RequestRoute(uint8_t train, BlockIndex from)
+{
+  TrainProgress& progress = s_trains[train];
+  const Route& route = TrainRoute(train);
+
+  uint8_t index = 0;
+  while (index + 1 < route.length && route.blocks[index] != from)
+  {
+    ++index;
+  }
+
+  if (index + 1 >= route.length)
+  {
+    return PointsThrowState::Failed;
+  }
+
+  if (progress.head != index)
+  {
+    uint8_t owner = s_blockOwner[from];
+    if (owner != NO_TRAIN && owner != train)
+    {
+      return PointsThrowState::Failed;
+    }
+
+    ReleaseTrain(train);
+    ReserveBlock(train, from);
+    progress.tail = index;
+    progress.head = index;
+    progress.reserved = index;
+    progress.held = false;
+  }
+
+  progress.active = true;
+
+  ExtendReservation(train);
+  if (progress.reserved == progress.head)
+  {
+    return PointsThrowState::Idle;
+  }
+
+  return SetReservedPoints(train);
+}
+
+// Apply track power for a train to the districts it holds. While
+// the interlocking is holding it the power is applied once it
+// can move on.
+void SetTrainPower(uint8_t train, TrackPowerState power)
+{
+  TrainProgress& progress = s_trains[train];
+  progress.power = power;
+  TrainPowerChanged(train, power);
+  if (power == TrackPowerState::Stop)
+  {
+    progress.held = false;
+  }
+
+  if (!progress.held)
+  {
+    ApplyPower(TrainDistricts(train), power);
+  }
+}
+
+// The train (LAYOUT_TRAIN_*) holding a block, or NO_TRAIN
+uint8_t BlockOwner(BlockIndex block)
+{
+  return s_blockOwner[block];
+}
\ No newline at end of file
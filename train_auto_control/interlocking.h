@@ -0,0 +1,31 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+#include "enums.h"
+#include "layout.h"
+#include "point_control.h"
+#include "train_control.h"
+#include "transit_timing.h"
+#include "telemetry.h"
+
+// Block reservation interlocking over the layout model. Each train
+// (LAYOUT_TRAIN_*) holds the blocks it's in and those reserved ahead
+// of it on its route. A block is only reserved if no other train
+// holds it, nor the points into it the other way, nor power in its
+// district while moving. Blocks are released as soon as their
+// detectors clear behind the train, and a train which runs out of
+// reserved blocks has its district's power cut until it can reserve
+// more. Trains on routes which don't share blocks, points or
+// districts can run at once.
+
+// Owner of a block nobody holds
+#define NO_TRAIN 0xFF
+
+void SetupInterlocking();
+void ResetInterlocking();
+void UpdateInterlocking();
+PointsThrowState RequestRoute(uint8_t train, BlockIndex from);
+void SetTrainPower(uint8_t train, TrackPowerState power);
+uint8_t BlockOwner(BlockIndex block);
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "journal.h"
+
+#include <string.h>
+
+#if defined(_JOURNAL)
+
+// Bump when a record's contents change, so older
+// records no longer check out
+#define JOURNAL_VERSION 1
+#define JOURNAL_SEED RecordSeed(JOURNAL_VERSION)
+
+#define NO_SLOT 0xFF
+
+static_assert(JOURNAL_SLOTS <= 128, "Status sequence numbers only order up to 128 slots");
+
+struct StatusRecord
+{
+  uint8_t sequence;
+  uint8_t current;
+  uint8_t previous;
+  uint8_t pointTargets[LAYOUT_POINTS_COUNT];
+  uint8_t crc[2];
+};
+
+struct LearnedState
+{
+  TransitTimingState transit;
+  SensorFilterState sensors[LAYOUT_BLOCK_COUNT];
+};
+
+struct LearnedRecord
+{
+  uint8_t sequence;
+  LearnedState state;
+  uint8_t crc[2];
+};
+
+#define JOURNAL_STATUS_BASE  0
+#define JOURNAL_LEARNED_BASE (JOURNAL_STATUS_BASE + JOURNAL_SLOTS * sizeof(StatusRecord))
+
+static_assert(JOURNAL_LEARNED_BASE + 2 * sizeof(LearnedRecord) <= CONFIG_EEPROM_BASE,
+              "Journal doesn't fit in the EEPROM below the config");
+
+// The status as last written, and where the next record goes
+static StatusRecord s_status;
+static uint8_t s_nextSlot = 0;
+
+// Sequence of the newest learned copy, and when it was saved
+static uint8_t s_learnedSequence = 0;
+static uint16_t s_learnedCrc = 0;
+static uint32_t s_learnedMillis = 0;
+
+// The record being written, a byte at a time
+static union
+{
+  StatusRecord status;
+  LearnedRecord learned;
+  uint8_t bytes[sizeof(LearnedRecord)];
+} s_writeBuffer;
+static uint16_t s_writeAddress = 0;
+static uint16_t s_writeLength = 0;
+static uint16_t s_writeIndex = 0;
+
+// True if sequence number a was written after b. Sequences
+// wrap, so this only holds for records less than 128 apart.
+static bool Newer(uint8_t a, uint8_t b)
+{
+  uint8_t ahead = a - b;
+  return ahead != 0 && ahead < 128;
+}
+
+static void StartWrite(uint16_t address, uint16_t length)
+{
+  s_writeAddress = address;
+  s_writeLength = length;
+  s_writeIndex = 0;
+}
+
+// Queue a status record if the status or point targets have
+// changed since the last one. Returns true if it did.
+static bool QueueStatus()
+{
+  StatusRecord status = s_status;
+  status.current = static_cast<uint8_t>(g_currentStatus);
+  status.previous = static_cast<uint8_t>(g_previousStatus);
+  for (uint8_t points = 0; points < LAYOUT_POINTS_COUNT; ++points)
+  {
+    status.pointTargets[points] = static_cast<uint8_t>(PointsTarget(points));
+  }
+
+  if (memcmp(&status, &s_status, sizeof(status)) == 0)
+  {
+    return false;
+  }
+
+  ++status.sequence;
+  SealRecord(reinterpret_cast<uint8_t*>(&status), sizeof(status), JOURNAL_SEED);
+  s_status = status;
+
+  s_writeBuffer.status = status;
+  StartWrite(JOURNAL_STATUS_BASE + s_nextSlot * sizeof(StatusRecord), sizeof(status));
+  s_nextSlot = (s_nextSlot + 1) % JOURNAL_SLOTS;
+  return true;
+}
+
+// Queue a learned record over the older copy if it's time
+// and anything has changed. Returns true if it did.
+static bool QueueLearned()
+{
+  if (HalMillis() - s_learnedMillis < JOURNAL_LEARNED_PERIOD)
+  {
+    return false;
+  }
+  s_learnedMillis = HalMillis();
+
+  LearnedRecord& learned = s_writeBuffer.learned;
+  SaveTransitTiming(learned.state.transit);
+  SaveSensorFilters(learned.state.sensors);
+
+  uint16_t crc = RecordCrc(reinterpret_cast<const uint8_t*>(&learned.state), sizeof(learned.state), JOURNAL_SEED);
+  if (crc == s_learnedCrc)
+  {
+    return false;
+  }
+  s_learnedCrc = crc;
+
+  learned.sequence = ++s_learnedSequence;
+  SealRecord(s_writeBuffer.bytes, sizeof(LearnedRecord), JOURNAL_SEED);
+  StartWrite(JOURNAL_LEARNED_BASE + (learned.sequence & 1) * sizeof(LearnedRecord), sizeof(LearnedRecord));
+  return true;
+}
+
+// Read back the newest status and learned records, restore what
+// they hold, and pick up the rings where they left off. Call once
+// at start up, after the Setup functions of the modules it restores
+// and once the inputs have settled.
+void RestoreJournal()
+{
+  uint8_t flags = 0;
+
+  uint8_t newest = NO_SLOT;
+  StatusRecord status;
+  for (uint8_t slot = 0; slot < JOURNAL_SLOTS; ++slot)
+  {
+    StatusRecord record;
+    if (ReadRecord(JOURNAL_STATUS_BASE + slot * sizeof(StatusRecord),
+                   reinterpret_cast<uint8_t*>(&record), sizeof(record), JOURNAL_SEED) &&
+        (newest == NO_SLOT || Newer(record.sequence, status.sequence)))
+    {
+      newest = slot;
+      status = record;
+    }
+  }
+
+  if (newest != NO_SLOT)
+  {
+    flags |= JOURNAL_STATUS_FOUND;
+    s_status = status;
+    s_nextSlot = (newest + 1) % JOURNAL_SLOTS;
+
+    PointsDirection targets[LAYOUT_POINTS_COUNT];
+    for (uint8_t points = 0; points < LAYOUT_POINTS_COUNT; ++points)
+    {
+      targets[points] = static_cast<PointsDirection>(status.pointTargets[points]);
+    }
+    RestorePoints(targets);
+
+    // Only trust the previous status if the trains are where
+    // the record says they were
+    UpdateOccupancy();
+    if (static_cast<uint8_t>(GetCurrentTrainStatus()) == status.current &&
+        status.previous < TRAIN_STATUS_COUNT)
+    {
+      flags |= JOURNAL_STATUS_RESUMED;
+      g_previousStatus = static_cast<TrainStatus>(status.previous);
+    }
+  }
+  else
+  {
+    // Nothing saved, so match the status the loop starts from
+    s_status.sequence = 0xFF;
+    s_status.current = static_cast<uint8_t>(TrainStatus::None);
+    s_status.previous = static_cast<uint8_t>(TrainStatus::None);
+  }
+
+  LearnedRecord& learned = s_writeBuffer.learned;
+  bool found = false;
+  for (uint8_t copy = 0; copy < 2; ++copy)
+  {
+    LearnedRecord record;
+    if (ReadRecord(JOURNAL_LEARNED_BASE + copy * sizeof(LearnedRecord),
+                   reinterpret_cast<uint8_t*>(&record), sizeof(record), JOURNAL_SEED) &&
+        (!found || Newer(record.sequence, learned.sequence)))
+    {
+      learned = record;
+      found = true;
+    }
+  }
+
+  if (found)
+  {
+    flags |= JOURNAL_LEARNED_FOUND;
+    RestoreTransitTiming(learned.state.transit);
+    RestoreSensorFilters(learned.state.sensors);
+    s_learnedSequence = learned.sequence;
+    s_learnedCrc = RecordCrc(reinterpret_cast<const uint8_t*>(&learned.state), sizeof(learned.state), JOURNAL_SEED);
+  }
+  s_learnedMillis = HalMillis();
+
+  LogEvent(LogEventId::JournalRestored, s_status.current, s_status.previous, flags);
+}
+
+// Write the next byte of the record in progress, or start the
+// next record if there's nothing in progress. Bytes which already
+// hold the right value are skipped, to save wear.
+void UpdateJournal()
+{
+  if (s_writeIndex == s_writeLength && !QueueStatus() && !QueueLearned())
+  {
+    return;
+  }
+
+  while (s_writeIndex < s_writeLength && HalEepromReady())
+  {
+    uint16_t address = s_writeAddress + s_writeIndex;
+    uint8_t value = s_writeBuffer.bytes[s_writeIndex++];
+    if (HalEepromRead(address) != value)
+    {
+      HalEepromWrite(address, value);
+      return;
+    }
+  }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+#include "config.h"
+#include "eeprom_record.h"
+#include "enums.h"
+#include "layout.h"
+#include "point_control.h"
+#include "sensor_filter.h"
+#include "state_control.h"
+#include "telemetry.h"
+#include "transit_timing.h"
+
+// Journal of the controller's state in EEPROM, so after a reset it
+// carries on from where it was. Two kinds of record, each ending in
+// a CRC (see eeprom_record.h) so a record torn by the power going
+// is ignored:
+// * Status: the current and previous status and the point targets,
+//   written whenever they change. Records go round a ring of
+//   JOURNAL_SLOTS, so each slot is only written one time in that
+//   many, and the newest valid one is used.
+// * Learned: transit times and sensor filter statistics, written
+//   every JOURNAL_LEARNED_PERIOD if they've changed, alternately
+//   to one of two copies.
+// Writes are a byte per run of UpdateJournal, as each takes the
+// EEPROM a few ms, so the loop never waits on them.
+//
+// At start up the points are driven to their saved targets, so
+// they aren't thrown again unless their feedback disagrees, and if
+// the sensors show the trains where the saved status has them the
+// previous status is restored too, so the right train leaves next.
+
+// Flags in the JournalRestored log record
+#define JOURNAL_STATUS_FOUND   0x01
+#define JOURNAL_STATUS_RESUMED 0x02
+#define JOURNAL_LEARNED_FOUND  0x04
+
+#if defined(_JOURNAL)
+void RestoreJournal();
+void UpdateJournal();
+#else
+inline void RestoreJournal() {}
+inline void UpdateJournal() {}
+#endif
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include "layout.h"
+#include "sensor_filter.h"
+
+static_assert(LAYOUT_BLOCK_COUNT <= sizeof(BlockSet) * 8, "Too many blocks for BlockSet");
+static_assert(LAYOUT_LINK_COUNT < 0xFF, "Too many links");
+
+// Check the description at compile time, so a typo in
+// layout_config.h can't send the route engine off the end
+// of its tables.
+constexpr bool LinksValid(uint8_t index)
+{
+  return index == LAYOUT_LINK_COUNT ||
+         (s_layoutLinks[index].from < LAYOUT_BLOCK_COUNT &&
+          s_layoutLinks[index].to < LAYOUT_BLOCK_COUNT &&
+          (s_layoutLinks[index].points == NO_POINTS ||
+           (s_layoutLinks[index].points < LAYOUT_POINTS_COUNT &&
+            s_layoutLinks[index].setting != PointsDirection::Invalid)) &&
+          LinksValid(index + 1));
+}
+
+constexpr bool TrainsValid(uint8_t index)
+{
+  return index == LAYOUT_TRAIN_COUNT ||
+         (s_layoutTrains[index].home < LAYOUT_BLOCK_COUNT && TrainsValid(index + 1));
+}
+
+constexpr bool BlocksValid(uint8_t index)
+{
+  return index == LAYOUT_BLOCK_COUNT ||
+         (s_layoutBlocks[index].district < LAYOUT_DISTRICT_COUNT && BlocksValid(index + 1));
+}
+
+static_assert(BlocksValid(0), "Block in layout_config.h is fed from a district that doesn't exist");
+static_assert(LinksValid(0), "Link in layout_config.h refers to a block or points that don't exist");
+static_assert(TrainsValid(0), "Train in layout_config.h starts from a block that doesn't exist");
+
+#define NO_LINK 0xFF
+
+// Blocks occupied as of the last UpdateOccupancy
+BlockSet g_occupiedBlocks = 0;
+
+// Each train's route round the layout, found at start up
+static Route s_trainRoutes[LAYOUT_TRAIN_COUNT];
+
+// Work out the route for every train. Routes only depend on the
+// layout, so this is the only place the route engine runs.
+void SetupLayout()
+{
+  for (uint8_t train = 0; train < LAYOUT_TRAIN_COUNT; ++train)
+  {
+    const TrainDef& trainDef = s_layoutTrains[train];
+    Route& route = s_trainRoutes[train];
+    if (!FindRoute(trainDef.home, trainDef.home, trainDef.forward, route))
+    {
+      // No way round, so the train must not be sent anywhere
+      route.length = 0;
+    }
+  }
+}
+
+// Update g_occupiedBlocks from g_inputs, riding out gaps in
+// current detection (see sensor_filter.h). One pass over the
+// blocks, so the cost grows only with the size of the layout.
+void UpdateOccupancy()
+{
+  BlockSet occupied = 0;
+  for (BlockIndex block = 0; block < LAYOUT_BLOCK_COUNT; ++block)
+  {
+    const BlockDef& blockDef = s_layoutBlocks[block];
+    bool active = g_inputs & blockDef.detector;
+    if (blockDef.currentDetector ? FilterSensor(block, active) : active)
+    {
+      occupied |= static_cast<BlockSet>(1) << block;
+    }
+  }
+  g_occupiedBlocks = occupied;
+}
+
+bool BlockOccupied(BlockIndex block)
+{
+  return g_occupiedBlocks & (static_cast<BlockSet>(1) << block);
+}
+
+// Find the shortest path from one block to another running in the
+// given direction, and the points settings it needs. from and to
+// can be the same block for a route round a loop. Returns false if
+// there's no path, or the only one found needs a set of points
+// both ways.
+bool FindRoute(BlockIndex from, BlockIndex to, bool forward, Route& route)
+{
+  // Breadth first search, remembering the link used to reach
+  // each block so the path can be followed back afterwards
+  uint8_t arrivedBy[LAYOUT_BLOCK_COUNT];
+  BlockIndex queue[LAYOUT_BLOCK_COUNT];
+  uint8_t queueHead = 0;
+  uint8_t queueTail = 0;
+  uint8_t finalLink = NO_LINK;
+
+  for (BlockIndex block = 0; block < LAYOUT_BLOCK_COUNT; ++block)
+  {
+    arrivedBy[block] = NO_LINK;
+  }
+
+  // For a loop the start is also the destination, so
+  // leave it unvisited for the search to come back to
+  BlockSet visited = from == to ? 0 : static_cast<BlockSet>(1) << from;
+  queue[queueTail++] = from;
+
+  while (queueHead < queueTail && finalLink == NO_LINK)
+  {
+    BlockIndex current = queue[queueHead++];
+
+    for (uint8_t link = 0; link < LAYOUT_LINK_COUNT; ++link)
+    {
+      const LinkDef& linkDef = s_layoutLinks[link];
+      BlockIndex source = forward ? linkDef.from : linkDef.to;
+      BlockIndex destination = forward ? linkDef.to : linkDef.from;
+
+      if (source != current)
+      {
+        continue;
+      }
+
+      if (destination == to)
+      {
+        finalLink = link;
+        break;
+      }
+
+      BlockSet destinationBit = static_cast<BlockSet>(1) << destination;
+      if (!(visited & destinationBit))
+      {
+        visited |= destinationBit;
+        arrivedBy[destination] = link;
+        queue[queueTail++] = destination;
+      }
+    }
+  }
+
+  if (finalLink == NO_LINK)
+  {
+    return false;
+  }
+
+  // Follow the links back to the start, filling in
+  // the blocks from the end of the route
+  uint8_t links[LAYOUT_BLOCK_COUNT];
+  uint8_t linkCount = 0;
+  links[linkCount++] = finalLink;
+  BlockIndex block = forward ? s_layoutLinks[finalLink].from : s_layoutLinks[finalLink].to;
+  while (block != from)
+  {
+    uint8_t link = arrivedBy[block];
+    links[linkCount++] = link;
+    block = forward ? s_layoutLinks[link].from : s_layoutLinks[link].to;
+  }
+
+  for (uint8_t points = 0; points < LAYOUT_POINTS_COUNT; ++points)
+  {
+    route.points[points] = PointsDirection::Invalid;
+  }
+
+  route.forward = forward;
+  route.length = 0;
+  route.blockSet = static_cast<BlockSet>(1) << from;
+  route.blocks[route.length++] = from;
+
+  while (linkCount > 0)
+  {
+    uint8_t link = links[--linkCount];
+    const LinkDef& linkDef = s_layoutLinks[link];
+    route.links[route.length - 1] = link;
+    BlockIndex next = forward ? linkDef.to : linkDef.from;
+    route.blocks[route.length++] = next;
+    route.blockSet |= static_cast<BlockSet>(1) << next;
+
+    if (linkDef.points != NO_POINTS)
+    {
+      PointsDirection& setting = route.points[linkDef.points];
+      if (setting != PointsDirection::Invalid && setting != linkDef.setting)
+      {
+        return false;
+      }
+      setting = linkDef.setting;
+    }
+  }
+
+  return true;
+}
+
+// The route found for a train (LAYOUT_TRAIN_*) at start up.
+// length is 0 if it has none.
+const Route& TrainRoute(uint8_t train)
+{
+  return s_trainRoutes[train];
+}
\ No newline at end of file
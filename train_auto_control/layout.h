@@ -0,0 +1,82 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+#include "enums.h"
+#include "inputs.h"
+
+// Generic model of the layout as a graph of blocks. A block is a
+// section of track with (usually) a detector of its own. Links
+// join blocks in the forward direction of travel, optionally only
+// when a set of points is set a given way. The layout itself is
+// described at compile time in layout_config.h; the occupancy
+// tracker and route engine here work from that description alone.
+
+typedef uint8_t BlockIndex;
+
+// One bit per block, so the model holds up to 16 blocks
+typedef uint16_t BlockSet;
+
+// Marks a link which doesn't depend on any points
+#define NO_POINTS 0xFF
+
+struct BlockDef
+{
+  // Input snapshot bit set while the block is occupied,
+  // or 0 if nothing detects it
+  InputSnapshot detector;
+  // True for a current detector, whose dropouts are filtered
+  // (see sensor_filter.h). Others, like the platforms' IR
+  // detectors, are taken as they read.
+  bool currentDetector;
+  // Which power district (LAYOUT_DISTRICT_*) feeds it
+  uint8_t district;
+};
+
+// A group of blocks fed from one set of track power outputs
+struct DistrictDef
+{
+  HalPin power;
+  HalPin direction;
+  HalPin fast;
+};
+
+struct LinkDef
+{
+  BlockIndex from;
+  BlockIndex to;
+  uint8_t points;
+  PointsDirection setting;
+};
+
+// Where a train starts from (and returns to) and which way it runs
+struct TrainDef
+{
+  BlockIndex home;
+  bool forward;
+};
+
+#include "layout_config.h"
+
+// A path through the layout and the points it needs. Blocks are
+// in order of travel, starting with the one the train is in.
+struct Route
+{
+  BlockIndex blocks[LAYOUT_BLOCK_COUNT + 1];
+  // The link (into s_layoutLinks) from each block to the next
+  uint8_t links[LAYOUT_BLOCK_COUNT];
+  uint8_t length;
+  BlockSet blockSet;
+  // Invalid for points the route doesn't pass through
+  PointsDirection points[LAYOUT_POINTS_COUNT];
+  bool forward;
+};
+
+void SetupLayout();
+void UpdateOccupancy();
+bool BlockOccupied(BlockIndex block);
+bool FindRoute(BlockIndex from, BlockIndex to, bool forward, Route& route);
+const Route& TrainRoute(uint8_t train);
+
+extern BlockSet g_occupiedBlocks;
\ No newline at end of file
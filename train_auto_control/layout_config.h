@@ -0,0 +1,77 @@
+#pragma once
+
+// Description of the layout in the readme for the layout model,
+// included from layout.h. Extending the layout means adding its
+// blocks, links and points here (and their inputs and outputs in
+// defines.h), not new code in the model.
+//
+//   Platform A -(X)-\                       /-(Y)- Platform A
+//                    Slow X - Fast Line - Slow Y
+//   Platform B -(X)-/                       \-(Y)- Platform B
+//
+// The platforms are detected by the IR sensors. The current detector
+// on Slow X also sees platform B while points X are set for it, and
+// likewise Slow Y and platform A, as they share a feed.
+
+#define BLOCK_PLATFORM_A 0
+#define BLOCK_PLATFORM_B 1
+#define BLOCK_SLOW_X     2
+#define BLOCK_FAST_LINE  3
+#define BLOCK_SLOW_Y     4
+#define LAYOUT_BLOCK_COUNT 5
+
+// Index of each set of points
+#define LAYOUT_POINTS_X 0
+#define LAYOUT_POINTS_Y 1
+#define LAYOUT_POINTS_COUNT 2
+
+// Each district has its own track power outputs, so trains in
+// different districts can run at once. The layout has a single
+// power supply, so it's all one district; another would need its
+// pins adding to output_pins in defines.h as well.
+#define LAYOUT_DISTRICT_MAIN 0
+#define LAYOUT_DISTRICT_COUNT 1
+
+// How many blocks ahead of a train to reserve. The state machine
+// checks every set of points on a route before the train departs,
+// so here the whole route is reserved at once.
+#define INTERLOCKING_LOOKAHEAD LAYOUT_BLOCK_COUNT
+
+#define LAYOUT_TRAIN_A 0
+#define LAYOUT_TRAIN_B 1
+#define LAYOUT_TRAIN_COUNT 2
+
+// Indexed by BLOCK_*
+constexpr BlockDef s_layoutBlocks[LAYOUT_BLOCK_COUNT] = {
+  { INPUT_TRAIN_A_IN_PLATFORM, false, LAYOUT_DISTRICT_MAIN }, // BLOCK_PLATFORM_A
+  { INPUT_TRAIN_B_IN_PLATFORM, false, LAYOUT_DISTRICT_MAIN }, // BLOCK_PLATFORM_B
+  { INPUT_TRAIN_ON_SLOW_X,     true,  LAYOUT_DISTRICT_MAIN }, // BLOCK_SLOW_X
+  { INPUT_TRAIN_ON_LINE,       true,  LAYOUT_DISTRICT_MAIN }, // BLOCK_FAST_LINE
+  { INPUT_TRAIN_ON_SLOW_Y,     true,  LAYOUT_DISTRICT_MAIN }  // BLOCK_SLOW_Y
+};
+
+// Indexed by LAYOUT_DISTRICT_*
+constexpr DistrictDef s_layoutDistricts[LAYOUT_DISTRICT_COUNT] = {
+  { HAL_PIN(TRACK_POWER_PIN), HAL_PIN(TRACK_DIRECTION_PIN), HAL_PIN(TRACK_FAST_PIN) } // LAYOUT_DISTRICT_MAIN
+};
+
+// Every way a train can move from one block to the next, in
+// the forward direction (train A's). Trains running in reverse
+// follow the same links backwards.
+constexpr LinkDef s_layoutLinks[] = {
+  { BLOCK_PLATFORM_A, BLOCK_SLOW_X,     LAYOUT_POINTS_X, PointsDirection::ForTrainA },
+  { BLOCK_PLATFORM_B, BLOCK_SLOW_X,     LAYOUT_POINTS_X, PointsDirection::ForTrainB },
+  { BLOCK_SLOW_X,     BLOCK_FAST_LINE,  NO_POINTS,       PointsDirection::Invalid   },
+  { BLOCK_FAST_LINE,  BLOCK_SLOW_Y,     NO_POINTS,       PointsDirection::Invalid   },
+  { BLOCK_SLOW_Y,     BLOCK_PLATFORM_A, LAYOUT_POINTS_Y, PointsDirection::ForTrainA },
+  { BLOCK_SLOW_Y,     BLOCK_PLATFORM_B, LAYOUT_POINTS_Y, PointsDirection::ForTrainB }
+};
+
+#define LAYOUT_LINK_COUNT (sizeof(s_layoutLinks) / sizeof(s_layoutLinks[0]))
+
+// Indexed by LAYOUT_TRAIN_*. Each runs round the loop from its
+// own platform back to it.
+constexpr TrainDef s_layoutTrains[LAYOUT_TRAIN_COUNT] = {
+  { BLOCK_PLATFORM_A, true },  // LAYOUT_TRAIN_A
+  { BLOCK_PLATFORM_B, false }  // LAYOUT_TRAIN_B
+};
\ No newline at end of file
@@ -5,47 +5,15 @@
 PointsDirection g_targetXPointStatus;
 PointsDirection g_targetYPointStatus;
 
-// Reads the input assigned as the X direction
-// point status. INVERT_X_POINT_FEEDBACK can be used to
-// control whether a 0 input refers to being aligned for 
-// train A or B. Returns which train the point is set for.
-PointsDirection GetXPointFeedbackStatus(uint16_t tries)
-{
-  bool xPlatAPinFeedback = digitalRead(POINT_X_PLAT_A_FEEDBACK_PIN) ^ INVERT_X_PLAT_A_POINT_FEEDBACK;
-  bool xPlatBPinFeedback = digitalRead(POINT_X_PLAT_B_FEEDBACK_PIN) ^ INVERT_X_PLAT_B_POINT_FEEDBACK;
-  
-  if (xPlatAPinFeedback && !xPlatBPinFeedback) { return PointsDirection::ForTrainA; }
-  if (!xPlatAPinFeedback && xPlatBPinFeedback) { return PointsDirection::ForTrainB; }
-
-  if (tries)
-  {
-    return GetXPointFeedbackStatus(tries - 1);
-  }
-
-  if (xPlatAPinFeedback && xPlatBPinFeedback) { PRINTLN("X Both high"); }
-  else { PRINTLN("X Both Low"); }
-  return PointsDirection::Invalid;
-}
-
-// Reads the input assigned as the Y direction
-// point status. INVERT_Y_POINT_FEEDBACK can be used to
-// control whether a 0 input refers to being aligned for 
-// train A or B. Returns which train the point is set for.
-PointsDirection GetYPointFeedbackStatus(uint16_t tries)
+// Convert the pair of feedback inputs for a set of points
+// into the direction they report.
+static PointsDirection DecodePointFeedback(InputSnapshot platAFeedback, InputSnapshot platBFeedback)
 {
-  bool yPlatAPinFeedback = digitalRead(POINT_Y_PLAT_A_FEEDBACK_PIN) ^ INVERT_Y_PLAT_A_POINT_FEEDBACK;
-  bool yPlatBPinFeedback = digitalRead(POINT_Y_PLAT_B_FEEDBACK_PIN) ^ INVERT_Y_PLAT_B_POINT_FEEDBACK;
+  bool platAPinFeedback = g_inputs & platAFeedback;
+  bool platBPinFeedback = g_inputs & platBFeedback;
 
-  if (yPlatAPinFeedback && !yPlatBPinFeedback) { return PointsDirection::ForTrainA; }
-  if (!yPlatAPinFeedback && yPlatBPinFeedback) { return PointsDirection::ForTrainB; }
-
-  if (tries)
-  {
-    return GetYPointFeedbackStatus(tries - 1);
-  }
-
-  if (yPlatAPinFeedback && yPlatBPinFeedback) { PRINTLN("Y Both high"); }
-  else { PRINTLN("Y Both Low"); }
+  if (platAPinFeedback && !platBPinFeedback) { return PointsDirection::ForTrainA; }
+  if (!platAPinFeedback && platBPinFeedback) { return PointsDirection::ForTrainB; }
   return PointsDirection::Invalid;
 }
 
@@ -107,85 +75,375 @@ bool PointsSetCorrectly(TrainStatus current)
   }
 }
 
-// Tries to change the Y points to target direction.
-// Due to this being a physical system, it may take time
-// for the feedback to report that it has actually changed.
-// Time before it gives up and reports an error can be
-// set by changing POINT_WAIT_PERIOD and POINT_WAIT_COUNT.
-// Whether ForTrainA is 0 or 1 can be set by changing
-// INVERT_Y_POINT_FEEDBACK
-bool SetYPointsDirection(PointsDirection targetDirection)
-{
-  DEBUG_PRINT("Changing Y points from "); 
-  DEBUG_PRINT(PointDirectionToString(g_targetYPointStatus));
-  DEBUG_PRINT(" to ");
-  DEBUG_PRINTLN(PointDirectionToString(targetDirection));
+static_assert(POINT_FEEDBACK_SAMPLES > 0 && POINT_FEEDBACK_SAMPLES <= 8, "POINT_FEEDBACK_SAMPLES must be 1 to 8");
 
-  g_targetYPointStatus = targetDirection;
+#define POINT_FEEDBACK_MASK ((1u << POINT_FEEDBACK_SAMPLES) - 1)
 
-  bool targetPinValue = (g_targetYPointStatus == PointsDirection::ForTrainB) ^ INVERT_Y_POINT_CONTROL;
+// Filtered feedback for one set of points. Samples are taken from
+// the input snapshot at least POINT_FEEDBACK_PERIOD apart, and the
+// direction is whichever way most of the last POINT_FEEDBACK_SAMPLES
+// read. Without a majority it stays as it was.
+struct PointsFeedback
+{
+  InputSnapshot platAInput;
+  InputSnapshot platBInput;
+  // One bit per sample, newest in bit 0, set if it read that way
+  uint8_t forTrainA;
+  uint8_t forTrainB;
+  uint32_t sampleMicros;
+  PointsDirection sample;
+  PointsDirection direction;
+  bool primed;
+  // Runs of samples which disagreed with the direction while the
+  // points weren't being thrown, i.e. bounce or a bad contact
+  uint16_t disagreements;
+  bool disagreeing;
+};
+
+// Everything needed to drive one set of points through a throw
+struct PointsActuator
+{
+  const char* name;
+  // Which set of points it is in the layout model (LAYOUT_POINTS_*)
+  uint8_t index;
+  PointsFeedback feedback;
+  PointsDirection* target;
+  PointsThrowState state;
+  uint32_t throwStart;
+  // Recovery sequence position, see RecoverPointsDirection
+  uint8_t recoveryStep;
+  PointsDirection recoveryTarget;
+  uint32_t recoveryFailedTime;
+};
+
+static PointsActuator s_xPoints = {
+  "X", LAYOUT_POINTS_X,
+  { INPUT_POINT_X_PLAT_A_FEEDBACK, INPUT_POINT_X_PLAT_B_FEEDBACK, 0, 0, 0,
+    PointsDirection::Invalid, PointsDirection::Invalid, false, 0, false },
+  &g_targetXPointStatus, PointsThrowState::Idle, 0, 0, PointsDirection::Invalid, 0
+};
+
+static PointsActuator s_yPoints = {
+  "Y", LAYOUT_POINTS_Y,
+  { INPUT_POINT_Y_PLAT_A_FEEDBACK, INPUT_POINT_Y_PLAT_B_FEEDBACK, 0, 0, 0,
+    PointsDirection::Invalid, PointsDirection::Invalid, false, 0, false },
+  &g_targetYPointStatus, PointsThrowState::Idle, 0, 0, PointsDirection::Invalid, 0
+};
+
+// Each set of points by its index in the layout model
+static PointsActuator* const s_layoutPoints[LAYOUT_POINTS_COUNT] = {
+  &s_xPoints, // LAYOUT_POINTS_X
+  &s_yPoints  // LAYOUT_POINTS_Y
+};
+
+// Returns true while a throw is still waiting on its feedback
+static bool PointsMoving(PointsThrowState state)
+{
+  return state == PointsThrowState::Driving || state == PointsThrowState::Confirming;
+}
 
-  digitalWrite(POINT_Y_CONTROL_PIN, targetPinValue);
+static uint8_t CountSamples(uint8_t samples)
+{
+  uint8_t count = 0;
+  for (; samples; samples &= samples - 1)
+  {
+    ++count;
+  }
+  return count;
+}
 
-  DEBUG_PRINT("Waiting on Y feedback...");
-  int i = 0;
-  do 
+// Take a feedback sample if POINT_FEEDBACK_PERIOD has passed
+// since the last one, and vote on the direction again.
+static void SampleFeedback(PointsActuator& points)
+{
+  PointsFeedback& feedback = points.feedback;
+  if (feedback.primed && g_inputsMicros - feedback.sampleMicros < POINT_FEEDBACK_PERIOD * 1000UL)
   {
-    delay(POINT_WAIT_PERIOD);
-    ++i;
-  } while (GetYPointFeedbackStatus() != g_targetYPointStatus && i < POINT_WAIT_COUNT);
+    return;
+  }
 
-  bool success = GetYPointFeedbackStatus() == g_targetYPointStatus;
+  feedback.sampleMicros = g_inputsMicros;
+  feedback.sample = DecodePointFeedback(feedback.platAInput, feedback.platBInput);
+  uint8_t forTrainA = feedback.sample == PointsDirection::ForTrainA;
+  uint8_t forTrainB = feedback.sample == PointsDirection::ForTrainB;
 
-  if(success)
+  PointsDirection direction = feedback.direction;
+  if (!feedback.primed)
   {
-    DEBUG_PRINTLN("Success");
+    // Nothing to outvote it yet, so start from the first sample
+    feedback.forTrainA = forTrainA ? POINT_FEEDBACK_MASK : 0;
+    feedback.forTrainB = forTrainB ? POINT_FEEDBACK_MASK : 0;
+    feedback.primed = true;
+    direction = feedback.sample;
   }
   else
   {
-    DEBUG_PRINTLN("Failure");
+    feedback.forTrainA = ((feedback.forTrainA << 1) | forTrainA) & POINT_FEEDBACK_MASK;
+    feedback.forTrainB = ((feedback.forTrainB << 1) | forTrainB) & POINT_FEEDBACK_MASK;
+
+    bool disagreeing = feedback.sample != feedback.direction && !PointsMoving(points.state);
+    if (disagreeing && !feedback.disagreeing && feedback.disagreements < 0xFFFF)
+    {
+      ++feedback.disagreements;
+      uint8_t payload[] = {
+        static_cast<uint8_t>(points.name[0]),
+        static_cast<uint8_t>(feedback.disagreements),
+        static_cast<uint8_t>(feedback.disagreements >> 8)
+      };
+      LogEvent(LogEventId::PointsFeedbackNoise, payload, sizeof(payload));
+    }
+    feedback.disagreeing = disagreeing;
+
+    uint8_t invalid = ~(feedback.forTrainA | feedback.forTrainB) & POINT_FEEDBACK_MASK;
+    if (CountSamples(feedback.forTrainA) > POINT_FEEDBACK_SAMPLES / 2)
+    {
+      direction = PointsDirection::ForTrainA;
+    }
+    else if (CountSamples(feedback.forTrainB) > POINT_FEEDBACK_SAMPLES / 2)
+    {
+      direction = PointsDirection::ForTrainB;
+    }
+    else if (CountSamples(invalid) > POINT_FEEDBACK_SAMPLES / 2)
+    {
+      direction = PointsDirection::Invalid;
+    }
+  }
+
+  // Log feedback which matches neither direction once each
+  // time it goes bad, rather than on every read
+  if (direction == PointsDirection::Invalid && (feedback.direction != direction || !feedback.primed))
+  {
+    bool bothActive = (g_inputs & feedback.platAInput) && (g_inputs & feedback.platBInput);
+    LogEvent(LogEventId::PointsFeedbackInvalid, points.name[0], bothActive ? 1 : 0);
   }
-  return success;
+  feedback.direction = direction;
+}
+
+// Reads the X direction point status, as filtered from the
+// input snapshot. g_config.feedbackInvert can be used to
+// control whether a 0 input refers to being aligned for 
+// train A or B. Returns which train the point is set for.
+PointsDirection GetXPointFeedbackStatus()
+{
+  return s_xPoints.feedback.direction;
 }
 
-// Tries to change the X points to target direction.
-// Due to this being a physical system, it may take time
-// for the feedback to report that it has actually changed.
-// Time before it gives up and reports an error can be
-// set by changing POINT_WAIT_PERIOD and POINT_WAIT_COUNT.
-// Whether ForTrainA is 0 or 1 can be set by changing
-// INVERT_X_POINT_FEEDBACK
-bool SetXPointsDirection(PointsDirection targetDirection)
+// Reads the Y direction point status, as filtered from the
+// input snapshot. g_config.feedbackInvert can be used to
+// control whether a 0 input refers to being aligned for 
+// train A or B. Returns which train the point is set for.
+PointsDirection GetYPointFeedbackStatus()
+{
+  return s_yPoints.feedback.direction;
+}
+
+// Returns the disagreements counted for a set of
+// points (by LAYOUT_POINTS_*), see PointsFeedback
+uint16_t PointsFeedbackDisagreements(uint8_t points)
 {
-  DEBUG_PRINT("Changing X points from "); 
-  DEBUG_PRINT(PointDirectionToString(g_targetXPointStatus));
-  DEBUG_PRINT(" to ");
-  DEBUG_PRINTLN(PointDirectionToString(targetDirection));
+  return s_layoutPoints[points]->feedback.disagreements;
+}
+
+// Drive the control output for a direction. Whether ForTrainA is 0
+// or 1 is set by g_config.pointControlInvert (INVERT_X_POINT_CONTROL /
+// INVERT_Y_POINT_CONTROL by default). Each pin is named directly,
+// so the write is a single instruction (see Pin in hal.h).
+static void WriteControl(const PointsActuator& points, PointsDirection direction)
+{
+  bool invert = (g_config.pointControlInvert >> points.index) & 1;
+  uint8_t level = (direction == PointsDirection::ForTrainB) ^ invert;
+  switch (points.index)
+  {
+    case LAYOUT_POINTS_X: Pin<POINT_X_CONTROL_PIN>::Write(level); break;
+    case LAYOUT_POINTS_Y: Pin<POINT_Y_CONTROL_PIN>::Write(level); break;
+  }
+}
 
-  g_targetXPointStatus = targetDirection;
+// Write the control output for the target direction and start
+// waiting on the feedback.
+static void StartThrow(PointsActuator& points, PointsDirection targetDirection)
+{
+  LogEvent(LogEventId::PointsThrow, points.name[0],
+           static_cast<uint8_t>(*points.target), static_cast<uint8_t>(targetDirection));
 
-  bool targetPinValue = (g_targetXPointStatus == PointsDirection::ForTrainB) ^ INVERT_X_POINT_CONTROL;
+  *points.target = targetDirection;
+  WriteControl(points, targetDirection);
 
-  digitalWrite(POINT_X_CONTROL_PIN, targetPinValue);
+  points.throwStart = HalMillis();
+  points.state = PointsThrowState::Driving;
+}
 
-  DEBUG_PRINT("Waiting on X feedback...");
-  int i = 0;
-  do 
+// Advance a throw in progress. Moves to Confirming once the latest
+// feedback sample agrees with the target, to Done once the vote on
+// the samples does and to Failed if that hasn't happened within
+// PointThrowTimeout().
+static void PollActuator(PointsActuator& points)
+{
+  if (!PointsMoving(points.state))
   {
-    delay(POINT_WAIT_PERIOD);
-    ++i;
-  } while (GetXPointFeedbackStatus() != g_targetXPointStatus && i < POINT_WAIT_COUNT);
+    return;
+  }
 
-  bool success = GetXPointFeedbackStatus() == g_targetXPointStatus;
-  if(success)
+  if (points.feedback.direction == *points.target)
   {
-    DEBUG_PRINTLN("Success");
+    LogEvent(LogEventId::PointsConfirmed, points.name[0]);
+    StatsPointsThrown(points.index, HalMillis() - points.throwStart);
+    points.state = PointsThrowState::Done;
+    return;
   }
-  else
+
+  points.state = points.feedback.sample == *points.target ?
+                 PointsThrowState::Confirming :
+                 PointsThrowState::Driving;
+
+  if (HalMillis() - points.throwStart >= PointThrowTimeout())
   {
-    DEBUG_PRINTLN("Failure");
+    LogEvent(LogEventId::PointsFailed, points.name[0]);
+    points.state = PointsThrowState::Failed;
   }
-  return success;
+}
+
+// Request a throw to the target direction. Repeated requests for the
+// same target report on the throw already in progress rather than
+// restarting it, so callers can simply ask again each loop. Points
+// at rest whose feedback already agrees aren't thrown, only have
+// their control output written to hold them there. A completed
+// throw is restarted if the feedback has since drifted.
+static PointsThrowState RequestThrow(PointsActuator& points, PointsDirection targetDirection)
+{
+  if (*points.target == targetDirection &&
+      (PointsMoving(points.state) || points.state == PointsThrowState::Failed))
+  {
+    return points.state;
+  }
+
+  if (!PointsMoving(points.state) && points.feedback.direction == targetDirection)
+  {
+    if (*points.target != targetDirection || points.state != PointsThrowState::Done)
+    {
+      *points.target = targetDirection;
+      WriteControl(points, targetDirection);
+      points.state = PointsThrowState::Done;
+    }
+    return points.state;
+  }
+
+  StartThrow(points, targetDirection);
+  return points.state;
+}
+
+// Drop a reported failure so the next request tries again.
+static void ClearFailure(PointsActuator& points)
+{
+  if (points.state == PointsThrowState::Failed)
+  {
+    points.state = PointsThrowState::Idle;
+  }
+}
+
+// Step through the recovery sequence for a failed set of points:
+// retry the target, and if that fails throw them the wrong way and
+// back again. Returns Done once the target is confirmed, Failed once
+// the whole sequence has been tried, otherwise the state of the throw
+// in progress. After a failed sequence it keeps returning Failed for
+// POINT_RECOVERY_RETRY_INTERVAL before starting again, rather than
+// working the points continuously, but finishes straight away if the
+// feedback comes right in the meantime (e.g. fixed by hand).
+static PointsThrowState RecoverPointsDirection(PointsActuator& points)
+{
+  if (points.recoveryStep == 4)
+  {
+    if (points.feedback.direction == points.recoveryTarget)
+    {
+      LogEvent(LogEventId::PointsRecovered, points.name[0]);
+      points.recoveryStep = 0;
+      points.state = PointsThrowState::Done;
+      return points.state;
+    }
+
+    if (HalMillis() - points.recoveryFailedTime < POINT_RECOVERY_RETRY_INTERVAL)
+    {
+      return PointsThrowState::Failed;
+    }
+
+    points.recoveryStep = 0;
+  }
+
+  if (points.recoveryStep == 0)
+  {
+    LogEvent(LogEventId::PointsRecoveryStart, points.name[0]);
+    points.recoveryTarget = *points.target;
+    ClearFailure(points);
+    points.recoveryStep = 1;
+  }
+
+  PointsDirection rightDirection = points.recoveryTarget;
+  PointsDirection wrongDirection = rightDirection == PointsDirection::ForTrainA ?
+                                                     PointsDirection::ForTrainB :
+                                                     PointsDirection::ForTrainA;
+
+  switch (points.recoveryStep)
+  {
+    case 1:
+    {
+      PointsThrowState state = RequestThrow(points, rightDirection);
+      if (PointsMoving(state)) { return state; }
+      if (state == PointsThrowState::Done) { break; }
+
+      LogEvent(LogEventId::PointsRecoveryWiggle, points.name[0]);
+      StartThrow(points, wrongDirection);
+      points.recoveryStep = 2;
+      return points.state;
+    }
+    case 2:
+    {
+      // Whether or not the wrong way confirmed, head back again
+      if (PointsMoving(points.state)) { return points.state; }
+      StartThrow(points, rightDirection);
+      points.recoveryStep = 3;
+      return points.state;
+    }
+    default:
+    {
+      if (PointsMoving(points.state)) { return points.state; }
+      if (points.state == PointsThrowState::Done) { break; }
+
+      LogEvent(LogEventId::PointsRecoveryFailed, points.name[0]);
+      points.recoveryStep = 4;
+      points.recoveryFailedTime = HalMillis();
+      ClearFailure(points);
+      return PointsThrowState::Failed;
+    }
+  }
+
+  LogEvent(LogEventId::PointsRecovered, points.name[0]);
+  points.recoveryStep = 0;
+  return PointsThrowState::Done;
+}
+
+// Non-blocking recovery of failed Y points. Call each loop
+// until it returns Done or Failed.
+PointsThrowState RecoverYPointsDirection()
+{
+  return RecoverPointsDirection(s_yPoints);
+}
+
+// Non-blocking recovery of failed X points. Call each loop
+// until it returns Done or Failed.
+PointsThrowState RecoverXPointsDirection()
+{
+  return RecoverPointsDirection(s_xPoints);
+}
+
+// Sample the point feedback and advance any throws in progress.
+// Should be called every loop, before the state machine looks
+// at the points.
+void PollPoints()
+{
+  SampleFeedback(s_xPoints);
+  SampleFeedback(s_yPoints);
+  PollActuator(s_xPoints);
+  PollActuator(s_yPoints);
 }
 
 // Convert enum to string for debug prints.
@@ -197,17 +455,82 @@ const char* PointDirectionToString(PointsDirection direction)
         case PointsDirection::ForTrainB: return "For Train B";
         case PointsDirection::Invalid:   return "Invalid";
     }
+    return "Unknown";
+}
+
+// Set every set of points (by LAYOUT_POINTS_*) to the given
+// setting, leaving those set to Invalid alone. All of them are
+// driven at once, so the route is ready as soon as the slowest
+// has confirmed. Call again each loop while it returns Driving
+// or Confirming. Returns Failed if any of them hasn't confirmed
+// within PointThrowTimeout(), set by g_config.pointWaitPeriod and
+// g_config.pointWaitCount (the failure is cleared, so the next
+// call retries), Done once all have confirmed.
+PointsThrowState SetPoints(const PointsDirection* settings)
+{
+  bool moving = false;
+  bool failed = false;
+
+  for (uint8_t i = 0; i < LAYOUT_POINTS_COUNT; ++i)
+  {
+    if (settings[i] == PointsDirection::Invalid)
+    {
+      continue;
+    }
+
+    PointsThrowState state = RequestThrow(*s_layoutPoints[i], settings[i]);
+    moving |= PointsMoving(state);
+    failed |= state == PointsThrowState::Failed;
+  }
+
+  if (moving)
+  {
+    return PointsThrowState::Driving;
+  }
+
+  if (failed)
+  {
+    for (uint8_t i = 0; i < LAYOUT_POINTS_COUNT; ++i)
+    {
+      ClearFailure(*s_layoutPoints[i]);
+    }
+    return PointsThrowState::Failed;
+  }
+
+  return PointsThrowState::Done;
+}
+
+// Returns true if a set of points (by LAYOUT_POINTS_*) has
+// been thrown to the given setting and confirmed
+bool PointsConfirmed(uint8_t points, PointsDirection setting)
+{
+  const PointsActuator& actuator = *s_layoutPoints[points];
+  return *actuator.target == setting && actuator.state == PointsThrowState::Done;
+}
+
+// Take up the targets (by LAYOUT_POINTS_*) the points had before
+// a restart, see journal.h. The control outputs are driven to match
+// straight away and the throws treated as done, so the points are
+// only thrown again if their feedback doesn't agree.
+void RestorePoints(const PointsDirection* targets)
+{
+  for (uint8_t i = 0; i < LAYOUT_POINTS_COUNT; ++i)
+  {
+    if (targets[i] != PointsDirection::ForTrainA && targets[i] != PointsDirection::ForTrainB)
+    {
+      continue;
+    }
+
+    PointsActuator& points = *s_layoutPoints[i];
+    *points.target = targets[i];
+    WriteControl(points, targets[i]);
+    points.state = PointsThrowState::Done;
+  }
 }
 
-// Try to set both points directions to the same thing.
-// Returns: 
-// 0 - Success
-// 1 - Y point failed
-// 2 - X point failed
-// 3 - Both points failed
-uint8_t SetPointsDirection(PointsDirection targetDirection)
+// The target (by LAYOUT_POINTS_*) each set of points was last
+// thrown to
+PointsDirection PointsTarget(uint8_t points)
 {
-  bool xSuccess = SetXPointsDirection(targetDirection);
-  bool ySuccess = SetYPointsDirection(targetDirection);
-  return (!xSuccess << 1) | !ySuccess;
+  return *s_layoutPoints[points]->target;
 }
\ No newline at end of file
@@ -1,18 +1,28 @@
 #pragma once
 
-#include <Arduino.h>
+#include "hal.h"
 
 #include "defines.h"
+#include "config.h"
 #include "enums.h"
+#include "inputs.h"
+#include "layout.h"
+#include "stats.h"
+#include "telemetry.h"
 
-PointsDirection GetXPointFeedbackStatus(uint16_t tries = POINT_TRIES);
-PointsDirection GetYPointFeedbackStatus(uint16_t tries = POINT_TRIES);
+PointsDirection GetXPointFeedbackStatus();
+PointsDirection GetYPointFeedbackStatus();
+uint16_t PointsFeedbackDisagreements(uint8_t points);
 bool PointsMatch();
 PointsDirection GetCurrentPointDirection();
 bool PointsSetCorrectly(TrainStatus current);
-bool SetXPointsDirection(PointsDirection targetDirection);
-bool SetYPointsDirection(PointsDirection targetDirection);
-uint8_t SetPointsDirection(PointsDirection targetDirection);
+PointsThrowState RecoverXPointsDirection();
+PointsThrowState RecoverYPointsDirection();
+PointsThrowState SetPoints(const PointsDirection* settings);
+bool PointsConfirmed(uint8_t points, PointsDirection setting);
+PointsDirection PointsTarget(uint8_t points);
+void RestorePoints(const PointsDirection* targets);
+void PollPoints();
 const char* PointDirectionToString(PointsDirection direction);
 
 extern PointsDirection g_targetXPointStatus;
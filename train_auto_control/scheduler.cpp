@@ -0,0 +1,74 @@
+#include "scheduler.h"
+
+static uint16_t Saturate(uint32_t value)
+{
+  return value > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(value);
+}
+
+// Reset the statistics and make every task due straight away
+void StartScheduler(Task* tasks, uint8_t count)
+{
+  uint32_t now = HalMicros();
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    tasks[i].nextRunMicros = now;
+    tasks[i].runs = 0;
+    tasks[i].overruns = 0;
+    tasks[i].maxLateMicros = 0;
+    tasks[i].maxRunMicros = 0;
+  }
+}
+
+// Run each task which is due. Call as often as possible.
+void RunScheduler(Task* tasks, uint8_t count)
+{
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    Task& task = tasks[i];
+    uint32_t now = HalMicros();
+    uint32_t late = now - task.nextRunMicros;
+
+    // Not due yet (the difference has wrapped negative)
+    if (static_cast<int32_t>(late) < 0)
+    {
+      continue;
+    }
+
+    if (late >= task.periodMicros)
+    {
+      if (task.overruns < 0xFFFF) { ++task.overruns; }
+      task.nextRunMicros = now;
+    }
+    task.nextRunMicros += task.periodMicros;
+
+    uint16_t lateMicros = Saturate(late);
+    if (lateMicros > task.maxLateMicros) { task.maxLateMicros = lateMicros; }
+
+    task.run();
+    ++task.runs;
+
+    uint16_t runMicros = Saturate(HalMicros() - now);
+    if (runMicros > task.maxRunMicros) { task.maxRunMicros = runMicros; }
+  }
+}
+
+// Log each task's statistics and start a new window for
+// the worst case figures.
+void LogTaskStats(Task* tasks, uint8_t count)
+{
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    Task& task = tasks[i];
+    uint8_t payload[] = {
+      i,
+      static_cast<uint8_t>(task.overruns), static_cast<uint8_t>(task.overruns >> 8),
+      static_cast<uint8_t>(task.maxLateMicros), static_cast<uint8_t>(task.maxLateMicros >> 8),
+      static_cast<uint8_t>(task.maxRunMicros), static_cast<uint8_t>(task.maxRunMicros >> 8)
+    };
+    LogEvent(LogEventId::TaskStats, payload, sizeof(payload));
+
+    task.overruns = 0;
+    task.maxLateMicros = 0;
+    task.maxRunMicros = 0;
+  }
+}
\ No newline at end of file
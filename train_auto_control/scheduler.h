@@ -0,0 +1,31 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+#include "telemetry.h"
+
+// Cooperative fixed rate scheduler. Each task is run every
+// periodMicros, in table order when several are due, so put the
+// most latency sensitive first. Tasks must return quickly; a task
+// that runs long delays the others, and the statistics show it.
+struct Task
+{
+  const char* name;
+  void (*run)();
+  uint32_t periodMicros;
+
+  // Kept by the scheduler
+  uint32_t nextRunMicros;
+  uint32_t runs;
+  // Times the task was a whole period or more late, i.e. missed
+  // a run. The missed runs are skipped rather than caught up.
+  uint16_t overruns;
+  // Worst case since the last LogTaskStats, saturating at 0xFFFF
+  uint16_t maxLateMicros;
+  uint16_t maxRunMicros;
+};
+
+void StartScheduler(Task* tasks, uint8_t count);
+void RunScheduler(Task* tasks, uint8_t count);
+void LogTaskStats(Task* tasks, uint8_t count);
\ No newline at end of file
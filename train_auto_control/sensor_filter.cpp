@@ -0,0 +1,174 @@
+#include "sensor_filter.h"
+
+static_assert(SENSOR_HOLDOFF_MAX <= (1u << (SENSOR_GAP_BUCKETS - 1)),
+              "SENSOR_HOLDOFF_MAX is too long for the gap histogram");
+static_assert(SENSOR_HOLDOFF_MIN <= SENSOR_DEBOUNCE_DELAY && SENSOR_DEBOUNCE_DELAY <= SENSOR_HOLDOFF_MAX,
+              "SENSOR_DEBOUNCE_DELAY must be between SENSOR_HOLDOFF_MIN and SENSOR_HOLDOFF_MAX");
+
+struct SensorFilter
+{
+  // When the detector last went inactive
+  uint32_t dropMicros;
+  // Gaps seen, by bucket, the number of times the detector has
+  // stayed inactive for longer than any gap (i.e. a train has
+  // left the block) and the hold-off they give
+  SensorFilterState learned;
+  // The detector as last seen, before filtering
+  bool raw;
+  // Inactive, but not yet for SENSOR_HOLDOFF_MAX
+  bool dropping;
+};
+
+// Indexed by block
+static SensorFilter s_sensorFilters[LAYOUT_BLOCK_COUNT];
+
+static uint8_t GapBucket(uint32_t millis)
+{
+  uint8_t bucket = 0;
+  while (millis > 0)
+  {
+    millis >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+// The longest gap in the bucket holding the 99.9th percentile
+// gap. Until a detector has shown a thousand gaps that's the
+// bucket of the longest one.
+static uint16_t GapPercentileMillis(const SensorFilter& filter)
+{
+  uint32_t total = 0;
+  for (uint8_t bucket = 0; bucket < SENSOR_GAP_BUCKETS; ++bucket)
+  {
+    total += filter.learned.gaps[bucket];
+  }
+
+  // How many gaps may be longer than the result
+  uint32_t allowed = total / 1000;
+  uint32_t longer = 0;
+  for (uint8_t bucket = SENSOR_GAP_BUCKETS; bucket-- > 0;)
+  {
+    longer += filter.learned.gaps[bucket];
+    if (longer > allowed)
+    {
+      return (1u << bucket) - 1;
+    }
+  }
+  return 0;
+}
+
+static void CountGap(SensorFilter& filter, uint32_t millis)
+{
+  uint16_t& count = filter.learned.gaps[GapBucket(millis)];
+  if (count == 0xFFFF)
+  {
+    // Halve the lot, which keeps the shape and
+    // lets older gaps count for less
+    for (uint8_t bucket = 0; bucket < SENSOR_GAP_BUCKETS; ++bucket)
+    {
+      filter.learned.gaps[bucket] >>= 1;
+    }
+  }
+  ++count;
+}
+
+static void UpdateHoldOff(BlockIndex block)
+{
+  SensorFilter& filter = s_sensorFilters[block];
+  uint16_t holdOff = GapPercentileMillis(filter) + SENSOR_HOLDOFF_MARGIN;
+
+  // Not enough trains seen to trust a short hold-off yet
+  if (filter.learned.passes < SENSOR_FILTER_MIN_PASSES && holdOff < g_config.sensorDebounceDelay)
+  {
+    holdOff = g_config.sensorDebounceDelay;
+  }
+
+  if (holdOff < SENSOR_HOLDOFF_MIN)
+  {
+    holdOff = SENSOR_HOLDOFF_MIN;
+  }
+  else if (holdOff > SENSOR_HOLDOFF_MAX)
+  {
+    holdOff = SENSOR_HOLDOFF_MAX;
+  }
+
+  if (holdOff != filter.learned.holdOffMillis)
+  {
+    filter.learned.holdOffMillis = holdOff;
+    uint8_t payload[] = { block, static_cast<uint8_t>(holdOff), static_cast<uint8_t>(holdOff >> 8) };
+    LogEvent(LogEventId::SensorHoldOff, payload, sizeof(payload));
+  }
+}
+
+void SetupSensorFilters()
+{
+  for (BlockIndex block = 0; block < LAYOUT_BLOCK_COUNT; ++block)
+  {
+    SensorFilter& filter = s_sensorFilters[block];
+    filter.dropMicros = 0;
+    filter.learned.holdOffMillis = g_config.sensorDebounceDelay;
+    for (uint8_t bucket = 0; bucket < SENSOR_GAP_BUCKETS; ++bucket)
+    {
+      filter.learned.gaps[bucket] = 0;
+    }
+    filter.learned.passes = 0;
+    filter.raw = false;
+    filter.dropping = false;
+  }
+}
+
+// Copy out what each block's filter has learned,
+// LAYOUT_BLOCK_COUNT of them
+void SaveSensorFilters(SensorFilterState* states)
+{
+  for (BlockIndex block = 0; block < LAYOUT_BLOCK_COUNT; ++block)
+  {
+    states[block] = s_sensorFilters[block].learned;
+  }
+}
+
+// Carry on from what the filters learned before a restart
+void RestoreSensorFilters(const SensorFilterState* states)
+{
+  for (BlockIndex block = 0; block < LAYOUT_BLOCK_COUNT; ++block)
+  {
+    s_sensorFilters[block].learned = states[block];
+    UpdateHoldOff(block);
+  }
+}
+
+// Filter a block's detector as of g_inputsMicros, returning
+// whether the block should be treated as occupied. Called
+// for every block on every pass of the state machine.
+bool FilterSensor(BlockIndex block, bool active)
+{
+  SensorFilter& filter = s_sensorFilters[block];
+  uint32_t gapMicros = g_inputsMicros - filter.dropMicros;
+
+  if (filter.dropping && (active || gapMicros >= SENSOR_HOLDOFF_MAX * 1000UL))
+  {
+    if (gapMicros < SENSOR_HOLDOFF_MAX * 1000UL)
+    {
+      // Back again, so it was only a gap
+      CountGap(filter, gapMicros / 1000);
+    }
+    else if (filter.learned.passes < 0xFFFF)
+    {
+      // Gone for good, the train has left
+      ++filter.learned.passes;
+    }
+    filter.dropping = false;
+    UpdateHoldOff(block);
+  }
+
+  if (filter.raw && !active)
+  {
+    filter.dropMicros = g_inputsMicros;
+    filter.dropping = true;
+    gapMicros = 0;
+  }
+  filter.raw = active;
+
+  return active || (filter.dropping && gapMicros < filter.learned.holdOffMillis * 1000UL);
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+#include "config.h"
+#include "enums.h"
+#include "inputs.h"
+#include "layout.h"
+#include "telemetry.h"
+
+// Dropout filter for the current detectors (see BlockDef in
+// layout.h). A detector which goes inactive is still treated as
+// active for its hold-off, in case it's only a gap in the
+// detection rather than the train leaving.
+//
+// Each detector learns its own hold-off. Every gap up to
+// SENSOR_HOLDOFF_MAX is counted in a histogram of powers of two
+// of ms, and the hold-off is the top of the bucket holding the
+// 99.9th percentile gap plus SENSOR_HOLDOFF_MARGIN. A clean
+// detector ends up at SENSOR_HOLDOFF_MIN, so trains are seen to
+// leave blocks sooner, while one with long gaps keeps a long
+// hold-off.
+
+// Gaps are counted by their length in ms rounded down
+// to a power of two: 0, 1, 2-3, 4-7 ... 256-511
+#define SENSOR_GAP_BUCKETS 10
+
+// What a filter has learned, kept over a restart by the journal
+struct SensorFilterState
+{
+  uint16_t holdOffMillis;
+  uint16_t passes;
+  uint16_t gaps[SENSOR_GAP_BUCKETS];
+};
+
+void SetupSensorFilters();
+void SaveSensorFilters(SensorFilterState* states);
+void RestoreSensorFilters(const SensorFilterState* states);
+bool FilterSensor(BlockIndex block, bool active);
\ No newline at end of file
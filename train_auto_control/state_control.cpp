@@ -6,18 +6,26 @@ TrainStatus g_nextStatus;
 
 uint32_t g_departureTime = INVALID_DEPARTURE_TIME;
 
-// Returns true if TRAIN_A_IN_PLATFORM_PIN is
-// low (inputs are active low), otherwise false.
+// When the current status was entered, for pacing retries
+static uint32_t s_statusEnteredTime = 0;
+
+// Set by RequestStop, holds the state machine in Stopped
+static bool s_stopRequested = false;
+
+// Returns true if the platform A block is occupied
+// (TRAIN_A_IN_PLATFORM_PIN low, inputs are active low)
+// as of the current inputs, otherwise false.
 bool TrainAInPlatform()
 {
-  return !digitalRead(TRAIN_A_IN_PLATFORM_PIN);
+  return BlockOccupied(BLOCK_PLATFORM_A);
 }
 
-// Returns true if TRAIN_B_IN_PLATFORM_PIN is
-// low (inputs are active low), otherwise false.
+// Returns true if the platform B block is occupied
+// (TRAIN_B_IN_PLATFORM_PIN low, inputs are active low)
+// as of the current inputs, otherwise false.
 bool TrainBInPlatform()
 {
-  return !digitalRead(TRAIN_B_IN_PLATFORM_PIN);
+  return BlockOccupied(BLOCK_PLATFORM_B);
 }
 
 // Returns true if both train in platform inputs
@@ -27,25 +35,28 @@ bool BothTrainsInPlatform()
   return TrainAInPlatform() && TrainBInPlatform();
 }
 
-// Returns true if TRAIN_ON_LINE pin is low
-// (inputs are active low), else false;
+// Returns true if the fast line block is occupied
+// (TRAIN_ON_LINE pin low, inputs are active low)
+// as of the current inputs, else false;
 bool TrainOnLine()
 {
-  return !digitalRead(TRAIN_ON_LINE_PIN);
+  return BlockOccupied(BLOCK_FAST_LINE);
 }
 
-// Returns true if TRAIN_ON_SLOW_DEPART_PIN
-// pin is low (inputs are active low), else false;
+// Returns true if the slow X block is occupied
+// (TRAIN_ON_SLOW_X_PIN low, inputs are active low)
+// as of the current inputs, else false;
 bool TrainOnSlowX()
 {
-    return !digitalRead(TRAIN_ON_SLOW_X_PIN);
+    return BlockOccupied(BLOCK_SLOW_X);
 }
 
-// Returns true if TRAIN_ON_SLOW_ARRIVE_PIN
-// pin is low (inputs are active low), else false;
+// Returns true if the slow Y block is occupied
+// (TRAIN_ON_SLOW_Y_PIN low, inputs are active low)
+// as of the current inputs, else false;
 bool TrainOnSlowY()
 {
-    return !digitalRead(TRAIN_ON_SLOW_Y_PIN);
+    return BlockOccupied(BLOCK_SLOW_Y);
 }
 
 // Calculates the departure time using an analogue input
@@ -55,25 +66,22 @@ uint32_t CalculateDepartureTime()
     // Input is 10 bits so could use a uint16_t here, but
     // we'd have to immediately cast to a uint32_t to not
     // have overflow issues in the dwell time calculation
-    uint32_t analogIn = analogRead(PLATFORM_DWELL_TIME_PIN);
+    uint32_t analogIn = HalAnalogRead(PLATFORM_DWELL_TIME_PIN);
 
-    DEBUG_PRINT("Reading analog in: "); DEBUG_PRINTLN(analogIn);
     // Divide should be optimised to a bit shift - could do
     // 1023 as that's the max real value but divides by non
     // powers of 2 are more expensive.
-    uint32_t dwellTime = (PLATFORM_DWELL_TIME * analogIn) / 1024;
-
-    DEBUG_PRINT("Dwell time set to: "); DEBUG_PRINT(dwellTime); DEBUG_PRINTLN("ms");
-
-    uint32_t currentTime = millis();
-
-    DEBUG_PRINT("Current time: "); DEBUG_PRINTLN(currentTime);
-
-    uint32_t departureTime = currentTime + dwellTime;
+    uint32_t dwellTime = (g_config.platformDwellTime * analogIn) / 1024;
 
-    DEBUG_PRINT("Departure time: "); DEBUG_PRINTLN(departureTime);
+    // The log's own timestamp gives the departure time
+    uint8_t payload[] = {
+      static_cast<uint8_t>(analogIn), static_cast<uint8_t>(analogIn >> 8),
+      static_cast<uint8_t>(dwellTime), static_cast<uint8_t>(dwellTime >> 8),
+      static_cast<uint8_t>(dwellTime >> 16), static_cast<uint8_t>(dwellTime >> 24)
+    };
+    LogEvent(LogEventId::DwellTime, payload, sizeof(payload));
 
-    return departureTime;
+    return HalMillis() + dwellTime;
 }
 
 // Function for figuring out the start up status.
@@ -139,35 +147,12 @@ TrainStatus GetCurrentTrainStatus()
   	return TrainStatus::TrainMissing;
 }
 
-// Resolve next status for situation where both are in the
-// platform.
+// Which train departs next from both in the platform.
 // Defaults to sending out opposite train to the one which just
 // ran, but if that information isn't available, default to points
 // If points are invalid, default to train A.
-TrainStatus NextStatusForBothInPlatform()
+static TrainStatus NextDeparture()
 {
-    if (g_departureTime == INVALID_DEPARTURE_TIME)
-    {
-        g_departureTime = CalculateDepartureTime();
-    }
-
-	if (!TrainAInPlatform() || !TrainBInPlatform())
-	{
-		return TrainStatus::TrainMissing;
-	}
-
-    if(millis() < g_departureTime)
-    {
-        DEBUG_PRINT(millis()); DEBUG_PRINT(" < "); DEBUG_PRINTLN(g_departureTime);
-        return TrainStatus::BothInPlatform;
-    }
-    else
-    {
-        // We are departing, so reset departure time
-        DEBUG_PRINTLN("Time to depart - resetting departure time!");
-        g_departureTime = INVALID_DEPARTURE_TIME;
-    }
-
 	if (g_previousStatus == TrainStatus::TrainAArrival)
 	{
 		return TrainStatus::TrainBDeparture;
@@ -185,15 +170,45 @@ TrainStatus NextStatusForBothInPlatform()
 		{
 			case PointsDirection::ForTrainA: return TrainStatus::TrainADeparture;
 			case PointsDirection::ForTrainB: return TrainStatus::TrainBDeparture;
+			// default to TrainADeparture
+			case PointsDirection::Invalid:   return TrainStatus::TrainADeparture;
 		}
 
-		// default to TrainADeparture
 		return TrainStatus::TrainADeparture;
 	}
 
 	return TrainStatus::InvalidState;
 }
 
+static void PrepareDeparture(TrainStatus departure);
+
+// Resolve next status for situation where both are in the
+// platform. While the trains dwell, the route and points are
+// made ready for the next departure, so it can leave as soon
+// as the dwell is up.
+TrainStatus NextStatusForBothInPlatform()
+{
+    if (g_departureTime == INVALID_DEPARTURE_TIME)
+    {
+        g_departureTime = CalculateDepartureTime();
+    }
+
+	if (!TrainAInPlatform() || !TrainBInPlatform())
+	{
+		return TrainStatus::TrainMissing;
+	}
+
+	TrainStatus departure = NextDeparture();
+
+    if(HalMillis() < g_departureTime)
+    {
+        PrepareDeparture(departure);
+        return TrainStatus::BothInPlatform;
+    }
+
+	return departure;
+}
+
 // Resolve next status when the current state is 
 // train A departing. The expected next state for
 // this is to move to Train A on line, however it
@@ -241,8 +256,6 @@ TrainStatus NextStatusForTrainADeparture()
 // do we want to wait for it to have fully crossed?)
 TrainStatus NextStatusForTrainAOnLine()
 {
-    static uint32_t trainALastSeen = 0;
-
     if (!TrainBInPlatform())
     {
         return TrainStatus::TrainMissing;
@@ -260,17 +273,10 @@ TrainStatus NextStatusForTrainAOnLine()
 
     if (TrainOnSlowY())
     {
-        trainALastSeen = millis();
         return TrainStatus::TrainAArrival;
     }
 
     if (TrainOnLine())
-    {
-        trainALastSeen = millis();
-        return TrainStatus::TrainAOnLine;
-    }
-
-    if (millis() - trainALastSeen < SENSOR_DEBOUNCE_DELAY)
     {
         return TrainStatus::TrainAOnLine;
     }
@@ -285,8 +291,6 @@ TrainStatus NextStatusForTrainAOnLine()
 // then stop and transition to both in platform.
 TrainStatus NextStatusForTrainAArrival()
 {
-    static uint32_t trainALastSeen = 0;
-
     if (!TrainBInPlatform())
     {
         return TrainStatus::TrainMissing;
@@ -304,17 +308,10 @@ TrainStatus NextStatusForTrainAArrival()
 
     if (TrainAInPlatform())
     {
-        trainALastSeen = millis();
         return TrainStatus::BothInPlatform;
     }
 
     if (TrainOnSlowY())
-    {
-        trainALastSeen = millis();
-        return TrainStatus::TrainAArrival;
-    }
-
-    if (millis() - trainALastSeen < SENSOR_DEBOUNCE_DELAY)
     {
         return TrainStatus::TrainAArrival;
     }
@@ -367,8 +364,6 @@ TrainStatus NextStatusForTrainBDeparture()
 // slow X inputs.
 TrainStatus NextStatusForTrainBOnLine()
 {
-    static uint32_t trainBLastSeen = 0;
-
     if (!TrainAInPlatform())
     {
         return TrainStatus::TrainMissing;
@@ -386,17 +381,10 @@ TrainStatus NextStatusForTrainBOnLine()
 
     if (TrainOnSlowX())
     {
-        trainBLastSeen = millis();
         return TrainStatus::TrainBArrival;
     }
 
     if (TrainOnLine())
-    {
-        trainBLastSeen = millis();
-        return TrainStatus::TrainBOnLine;
-    }
-
-    if(millis() - trainBLastSeen < SENSOR_DEBOUNCE_DELAY)
     {
         return TrainStatus::TrainBOnLine;
     }
@@ -411,7 +399,6 @@ TrainStatus NextStatusForTrainBOnLine()
 // transition to "both in platform", else 
 TrainStatus NextStatusForTrainBArrival()
 {
-    static uint32_t trainBLastSeen = 0;
     if (!TrainAInPlatform())
     {
         return TrainStatus::TrainMissing;
@@ -429,17 +416,10 @@ TrainStatus NextStatusForTrainBArrival()
 
     if (TrainBInPlatform())
     {
-        trainBLastSeen = millis();
         return TrainStatus::BothInPlatform;
     }
 
     if (TrainOnSlowX())
-    {
-        trainBLastSeen = millis();
-        return TrainStatus::TrainBArrival;
-    }
-
-    if(millis() - trainBLastSeen < SENSOR_DEBOUNCE_DELAY)
     {
         return TrainStatus::TrainBArrival;
     }
@@ -448,69 +428,30 @@ TrainStatus NextStatusForTrainBArrival()
 }
 
 // We have a points failure. We should try to resolve this so
-// we can move back to our previous state.
+// we can move back to our previous state. Recovery throws the
+// points in the background, so stay in the failure state until
+// it has either fixed them or given up.
 TrainStatus ResolveYPointFailure()
 {
-	DEBUG_PRINTLN("Trying to resolve Y point failure");
-    // Try again to reset the points. If we succeed
-	// return to previous state
-	if (SetYPointsDirection(g_targetYPointStatus))
+	if (RecoverYPointsDirection() == PointsThrowState::Done)
 	{
 		return g_previousStatus;
 	}
 
-	DEBUG_PRINTLN("Failed to set points, trying to switch them back and forth");
-	// Try to move the points the wrong way, then back
-	// again
-	// Copy target direction because setting will overwrite it
-	PointsDirection rightDirection = g_targetYPointStatus;
-	PointsDirection wrongDirection = rightDirection == PointsDirection::ForTrainA ?
-													   PointsDirection::ForTrainB :
-													   PointsDirection::ForTrainA;
-
-	SetYPointsDirection(wrongDirection);
-
-	if(SetYPointsDirection(rightDirection))
-	{
-		DEBUG_PRINTLN("Points fixed!");
-		return g_previousStatus;
-	}    
-
-	DEBUG_PRINTLN("Points still failed");
 	return TrainStatus::YPointFailure;
 }
 
 // We have a points failure. We should try to resolve this so
-// we can move back to our previous state.
+// we can move back to our previous state. Recovery throws the
+// points in the background, so stay in the failure state until
+// it has either fixed them or given up.
 TrainStatus ResolveXPointFailure()
 {
-	DEBUG_PRINTLN("Trying to resolve X point failure");
-    // Try again to reset the points. If we succeed
-	// return to previous state
-	if (SetXPointsDirection(g_targetXPointStatus))
+	if (RecoverXPointsDirection() == PointsThrowState::Done)
 	{
-		DEBUG_PRINTLN("Points fixed!");
 		return g_previousStatus;
 	}
 
-	DEBUG_PRINTLN("Failed to set points, trying to switch them back and forth");
-	// Try to move the points the wrong way, then back
-	// again
-	// Copy target direction because setting will overwrite it
-	PointsDirection rightDirection = g_targetXPointStatus;
-	PointsDirection wrongDirection = rightDirection == PointsDirection::ForTrainA ?
-													   PointsDirection::ForTrainB :
-													   PointsDirection::ForTrainA;
-
-	SetXPointsDirection(wrongDirection);
-
-	if(SetXPointsDirection(rightDirection))
-	{
-		DEBUG_PRINTLN("Points fixed!");
-		return g_previousStatus;
-	}    
-
-	DEBUG_PRINTLN("Points still failed");
 	return TrainStatus::XPointFailure;
 }
 
@@ -518,322 +459,332 @@ TrainStatus ResolveXPointFailure()
 // where it is. We can re-use the start up function here
 TrainStatus ResolveTrainMissingFailure()
 {
-	DEBUG_PRINTLN("Trying to resolve train missing failure");
     return GetCurrentTrainStatus();
 }
 
 // We have an invalid state. Try to reset to start
 TrainStatus ResolveInvalidState()
 {
-	DEBUG_PRINT("Trying to resolve invalid state: "); 
-	DEBUG_PRINTLN(StateToString(g_currentStatus));
 	return GetCurrentTrainStatus();
 }
 
-// We have an failed transition. Try to reset to start
+// We have an failed transition. Try to reset to start,
+// once whatever failed has had TRANSITION_RETRY_INTERVAL
+// to settle.
 TrainStatus ResolveFailedTransition()
 {
-	DEBUG_PRINT("Trying to resolve failed transition from "); 
-	DEBUG_PRINT(StateToString(g_previousStatus));
-	DEBUG_PRINT(" to ");
-	DEBUG_PRINTLN(StateToString(g_currentStatus));
+	if (HalMillis() - s_statusEnteredTime < TRANSITION_RETRY_INTERVAL)
+	{
+		return TrainStatus::TransitionFailure;
+	}
+
 	return GetCurrentTrainStatus();
 }
 
-TrainStatus GetNextTrainStatus()
+// Stopped until the console resumes, which it has if we get
+// here. Work out where the trains are and carry on from there.
+TrainStatus ResolveStopped()
 {
-  switch (g_currentStatus)
-  {
-    case TrainStatus::BothInPlatform:    return NextStatusForBothInPlatform();  
-    case TrainStatus::TrainADeparture:   return NextStatusForTrainADeparture();
-    case TrainStatus::TrainAOnLine:      return NextStatusForTrainAOnLine();    
-    case TrainStatus::TrainAArrival:     return NextStatusForTrainAArrival();   
-    case TrainStatus::TrainBDeparture:   return NextStatusForTrainBDeparture();
-    case TrainStatus::TrainBOnLine:      return NextStatusForTrainBOnLine();    
-    case TrainStatus::TrainBArrival:     return NextStatusForTrainBArrival();    
-    case TrainStatus::YPointFailure:     return ResolveYPointFailure();
-    case TrainStatus::XPointFailure:     return ResolveXPointFailure();
-    case TrainStatus::TrainMissing:      return ResolveTrainMissingFailure();
-    case TrainStatus::TransitionFailure: return ResolveFailedTransition();
-	default:							 return ResolveInvalidState();
-  }
+	return GetCurrentTrainStatus();
 }
 
-bool TransitionFromNoneOrError()
+// Stop everything from any state, or carry on afterwards. The
+// state machine goes to Stopped with the next step, and stays
+// there until resumed.
+void RequestStop(bool stop)
 {
-	switch (g_nextStatus)
-	{
-		case TrainStatus::BothInPlatform:
-		{
-			return true;
-		}   
-		case TrainStatus::TrainADeparture:  
-		{
-			if(SetPointsDirection(PointsDirection::ForTrainA))
-			{
-				return false;
-			}
-			SetTrackPowerState(TrackPowerState::ForwardSlow);
-			return true;
-		}
-		case TrainStatus::TrainAOnLine:  
-		{
-			if(SetPointsDirection(PointsDirection::ForTrainA))
-			{
-				return false;
-			}
-			SetTrackPowerState(TrackPowerState::ForwardFast);
-			return true;
-		}   
-		case TrainStatus::TrainAArrival:  
-		{
-			if(SetPointsDirection(PointsDirection::ForTrainA))
-			{
-				return false;
-			}
-			SetTrackPowerState(TrackPowerState::ForwardSlow);
-			return true;
-		}  
-		case TrainStatus::TrainBDeparture:  
-		{
-			if(SetPointsDirection(PointsDirection::ForTrainB))
-			{
-				return false;
-			}
-			SetTrackPowerState(TrackPowerState::ReverseSlow);
-			return true;
-		}
-		case TrainStatus::TrainBOnLine:    
-		{
-			if(SetPointsDirection(PointsDirection::ForTrainB))
-			{
-				return false;
-			}
-			SetTrackPowerState(TrackPowerState::ReverseFast);
-			return true;
-		} 
-		case TrainStatus::TrainBArrival:   
-		{
-			if(SetPointsDirection(PointsDirection::ForTrainB))
-			{
-				return false;
-			}
-			SetTrackPowerState(TrackPowerState::ReverseSlow);
-			return true;
-		} 
-	}
-	return false;
+  s_stopRequested = stop;
 }
 
-bool TransitionFromBothInPlatform()
+bool StopRequested()
 {
-    if (g_nextStatus == TrainStatus::TrainADeparture)
-    {
-        if (SetPointsDirection(PointsDirection::ForTrainA))
-        {
-			DEBUG_PRINTLN("Failed to set points for train B");
-            return false;
-        }
-
-        SetTrackPowerState(TrackPowerState::ForwardSlow);
-        return true;
-    }
+  return s_stopRequested;
+}
 
-    if (g_nextStatus == TrainStatus::TrainBDeparture)
-    {
-        if (SetPointsDirection(PointsDirection::ForTrainB))
-        {
-            return false;
-        }
+typedef TrainStatus (*NextStatusFunction)();
 
-        SetTrackPowerState(TrackPowerState::ReverseSlow);
-        return true;
-    }
+// Function resolving the next status for each status, indexed
+// by TrainStatus. Statuses without their own handler try to work
+// out where the trains are from scratch.
+static const NextStatusFunction s_nextStatusFunctions[TRAIN_STATUS_COUNT] PROGMEM = {
+  ResolveInvalidState,          // None
+  NextStatusForBothInPlatform,  // BothInPlatform
+  NextStatusForTrainADeparture, // TrainADeparture
+  NextStatusForTrainAOnLine,    // TrainAOnLine
+  NextStatusForTrainAArrival,   // TrainAArrival
+  NextStatusForTrainBDeparture, // TrainBDeparture
+  NextStatusForTrainBOnLine,    // TrainBOnLine
+  NextStatusForTrainBArrival,   // TrainBArrival
+  ResolveInvalidState,          // TrainErrorBase
+  ResolveTrainMissingFailure,   // TrainMissing
+  ResolveXPointFailure,         // XPointFailure
+  ResolveYPointFailure,         // YPointFailure
+  ResolveInvalidState,          // InvalidState
+  ResolveFailedTransition,      // TransitionFailure
+  ResolveStopped                // Stopped
+};
 
-	// we want to enter the error state, not transition failure.
-	if (g_nextStatus >= TrainStatus::TrainErrorBase)
-	{
-		SetTrackPowerState(TrackPowerState::Stop);
-		return true;
-	}
+TrainStatus GetNextTrainStatus()
+{
+  if (s_stopRequested)
+  {
+    return TrainStatus::Stopped;
+  }
 
-    return false;
-}
+  uint8_t current = static_cast<uint8_t>(g_currentStatus);
+  if (current >= TRAIN_STATUS_COUNT)
+  {
+    return ResolveInvalidState();
+  }
 
-// A transitions
-bool TransitionFromTrainADeparture()
-{
-    if (g_nextStatus == TrainStatus::TrainAOnLine)
-    {
-        SetTrackPowerState(TrackPowerState::ForwardFast);
-        return true;
-    }
+  NextStatusFunction nextStatusFunction =
+    reinterpret_cast<NextStatusFunction>(pgm_read_ptr(&s_nextStatusFunctions[current]));
+  return nextStatusFunction();
+}
+
+// A transition rule packs whether a transition is allowed, whether
+// the train's route (see layout_config.h) must be reserved and its
+// points set before it (Invalid if not, else the train's direction
+// for the points) and the track power to apply after, into one byte.
+typedef uint8_t TransitionRule;
+
+#define RULE_ALLOWED      0x80
+#define RULE_POINTS_SHIFT 3
+#define RULE_POINTS_MASK  0x03
+#define RULE_POWER_MASK   0x07
+
+constexpr TransitionRule Rule(PointsDirection points, TrackPowerState power)
+{
+  return RULE_ALLOWED |
+         (static_cast<uint8_t>(points) << RULE_POINTS_SHIFT) |
+         static_cast<uint8_t>(power);
+}
+
+// Shorthand for the table below
+#define NO  0
+#define STP Rule(PointsDirection::Invalid,   TrackPowerState::Stop)
+#define FS  Rule(PointsDirection::Invalid,   TrackPowerState::ForwardSlow)
+#define FF  Rule(PointsDirection::Invalid,   TrackPowerState::ForwardFast)
+#define RS  Rule(PointsDirection::Invalid,   TrackPowerState::ReverseSlow)
+#define RF  Rule(PointsDirection::Invalid,   TrackPowerState::ReverseFast)
+#define AFS Rule(PointsDirection::ForTrainA, TrackPowerState::ForwardSlow)
+#define AFF Rule(PointsDirection::ForTrainA, TrackPowerState::ForwardFast)
+#define BRS Rule(PointsDirection::ForTrainB, TrackPowerState::ReverseSlow)
+#define BRF Rule(PointsDirection::ForTrainB, TrackPowerState::ReverseFast)
+
+// What to do to move from one status (row) to another (column).
+// NO means the transition isn't allowed and is a transition failure.
+// Errors stop the train from any running state, and a stop from the
+// console (Stopped) from any state at all. From start up or an
+// error the points are set for wherever the trains were found.
+// Adding a state means adding a row and a column here.
+static const TransitionRule s_transitions[TRAIN_STATUS_COUNT][TRAIN_STATUS_COUNT] PROGMEM = {
+//  None Both ADep AOn  AArr BDep BOn  BArr EBas Miss XPt  YPt  Inv  TFail Stop
+  { NO,  STP, AFS, AFF, AFS, BRS, BRF, BRS, NO,  NO,  NO,  NO,  NO,  NO,  STP }, // None
+  { NO,  NO,  AFS, NO,  NO,  BRS, NO,  NO,  STP, STP, STP, STP, STP, STP, STP }, // BothInPlatform
+  { NO,  NO,  NO,  FF,  NO,  NO,  NO,  NO,  STP, STP, STP, STP, STP, STP, STP }, // TrainADeparture
+  { NO,  NO,  NO,  NO,  FS,  NO,  NO,  NO,  STP, STP, STP, STP, STP, STP, STP }, // TrainAOnLine
+  { NO,  STP, NO,  NO,  NO,  NO,  NO,  NO,  STP, STP, STP, STP, STP, STP, STP }, // TrainAArrival
+  { NO,  NO,  NO,  NO,  NO,  NO,  RF,  NO,  STP, STP, STP, STP, STP, STP, STP }, // TrainBDeparture
+  { NO,  NO,  NO,  NO,  NO,  NO,  NO,  RS,  STP, STP, STP, STP, STP, STP, STP }, // TrainBOnLine
+  { NO,  STP, NO,  NO,  NO,  NO,  NO,  NO,  STP, STP, STP, STP, STP, STP, STP }, // TrainBArrival
+  { NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO  }, // TrainErrorBase
+  { NO,  STP, AFS, AFF, AFS, BRS, BRF, BRS, NO,  NO,  NO,  NO,  NO,  NO,  STP }, // TrainMissing
+  { NO,  STP, AFS, AFF, AFS, BRS, BRF, BRS, NO,  NO,  NO,  NO,  NO,  NO,  STP }, // XPointFailure
+  { NO,  STP, AFS, AFF, AFS, BRS, BRF, BRS, NO,  NO,  NO,  NO,  NO,  NO,  STP }, // YPointFailure
+  { NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  NO,  STP }, // InvalidState
+  { NO,  STP, AFS, AFF, AFS, BRS, BRF, BRS, NO,  NO,  NO,  NO,  NO,  NO,  STP }, // TransitionFailure
+  { NO,  STP, AFS, AFF, AFS, BRS, BRF, BRS, NO,  NO,  NO,  NO,  NO,  NO,  NO  }  // Stopped
+};
+
+#undef NO
+#undef STP
+#undef FS
+#undef FF
+#undef RS
+#undef RF
+#undef AFS
+#undef AFF
+#undef BRS
+#undef BRF
+
+// Which train (LAYOUT_TRAIN_*) each status is about and the
+// block it's in at the start of it, for the interlocking
+struct StatusTrain
+{
+  uint8_t train;
+  BlockIndex block;
+};
+
+static const StatusTrain s_statusTrains[TRAIN_STATUS_COUNT] PROGMEM = {
+  { NO_TRAIN,       0                }, // None
+  { NO_TRAIN,       0                }, // BothInPlatform
+  { LAYOUT_TRAIN_A, BLOCK_PLATFORM_A }, // TrainADeparture
+  { LAYOUT_TRAIN_A, BLOCK_FAST_LINE  }, // TrainAOnLine
+  { LAYOUT_TRAIN_A, BLOCK_SLOW_Y     }, // TrainAArrival
+  { LAYOUT_TRAIN_B, BLOCK_PLATFORM_B }, // TrainBDeparture
+  { LAYOUT_TRAIN_B, BLOCK_FAST_LINE  }, // TrainBOnLine
+  { LAYOUT_TRAIN_B, BLOCK_SLOW_X     }, // TrainBArrival
+  { NO_TRAIN,       0                }, // TrainErrorBase
+  { NO_TRAIN,       0                }, // TrainMissing
+  { NO_TRAIN,       0                }, // XPointFailure
+  { NO_TRAIN,       0                }, // YPointFailure
+  { NO_TRAIN,       0                }, // InvalidState
+  { NO_TRAIN,       0                }, // TransitionFailure
+  { NO_TRAIN,       0                }  // Stopped
+};
+
+// Apply the rule for moving from the current status to the next.
+// Reserves the train's route and sets its points first if the rule
+// needs them, and applies the track power once they have confirmed.
+// The train doesn't move while the points are pending, and the
+// caller asks again next loop. Power goes to the train the next
+// status is about, or the one the current status is about when
+// it stops; if neither is about a train it goes everywhere.
+static TransitionResult ApplyTransitionRule()
+{
+  uint8_t current = static_cast<uint8_t>(g_currentStatus);
+  uint8_t next = static_cast<uint8_t>(g_nextStatus);
+  if (current >= TRAIN_STATUS_COUNT || next >= TRAIN_STATUS_COUNT)
+  {
+    return TransitionResult::Failed;
+  }
 
-	// we want to enter the error state, not transition failure.
-	if (g_nextStatus >= TrainStatus::TrainErrorBase)
-	{
-		SetTrackPowerState(TrackPowerState::Stop);
-		return true;
-	}
+  TransitionRule rule = pgm_read_byte(&s_transitions[current][next]);
+  if (!(rule & RULE_ALLOWED))
+  {
+    return TransitionResult::Failed;
+  }
 
-    return false;
-}
+  uint8_t train = pgm_read_byte(&s_statusTrains[next].train);
 
-bool TransitionFromTrainAOnLine()
-{
-    if (g_nextStatus == TrainStatus::TrainAArrival)
+  PointsDirection points = static_cast<PointsDirection>((rule >> RULE_POINTS_SHIFT) & RULE_POINTS_MASK);
+  if (points != PointsDirection::Invalid)
+  {
+    if (train == NO_TRAIN)
     {
-        SetTrackPowerState(TrackPowerState::ForwardSlow);
-        return true;
+      return TransitionResult::Failed;
     }
 
-	// we want to enter the error state, not transition failure.
-	if (g_nextStatus >= TrainStatus::TrainErrorBase)
-	{
-		SetTrackPowerState(TrackPowerState::Stop);
-		return true;
-	}
-
-    return false;
-}
+    PointsThrowState pointsState = RequestRoute(train, pgm_read_byte(&s_statusTrains[next].block));
 
-bool TransitionFromTrainAArrival()
-{
-    if(g_nextStatus == TrainStatus::BothInPlatform)
+    if (pointsState == PointsThrowState::Failed)
     {
-        SetTrackPowerState(TrackPowerState::Stop);
-        return true;
+      return TransitionResult::Failed;
     }
 
-	// we want to enter the error state, not transition failure.
-	if (g_nextStatus >= TrainStatus::TrainErrorBase)
-	{
-		SetTrackPowerState(TrackPowerState::Stop);
-		return true;
-	}
-
-    return false;
-}
-
-// B transitions
-bool TransitionFromTrainBDeparture()
-{
-    if (g_nextStatus == TrainStatus::TrainBOnLine)
+    if (pointsState != PointsThrowState::Done)
     {
-        SetTrackPowerState(TrackPowerState::ReverseFast);
-        return true;
+      return TransitionResult::Pending;
     }
+  }
 
-	// we want to enter the error state, not transition failure.
-	if (g_nextStatus >= TrainStatus::TrainErrorBase)
-	{
-		SetTrackPowerState(TrackPowerState::Stop);
-		return true;
-	}
+  if (train == NO_TRAIN)
+  {
+    train = pgm_read_byte(&s_statusTrains[current].train);
+  }
 
-    return false;
+  TrackPowerState power = static_cast<TrackPowerState>(rule & RULE_POWER_MASK);
+  if (train == NO_TRAIN)
+  {
+    SetTrackPowerState(TrackPowerSpeed(power));
+  }
+  else
+  {
+    SetTrainPower(train, PlanTrainPower(train, power));
+  }
+
+  return TransitionResult::Complete;
 }
 
-bool TransitionFromTrainBOnLine()
+// Reserve the route and start setting the points for a departure
+// from BothInPlatform ahead of time. Asked again each loop, this
+// picks up a throw in progress, and once the points confirm the
+// departure's own transition finds them Done. A failure is left
+// for that transition to act on.
+static void PrepareDeparture(TrainStatus departure)
 {
-    if (g_nextStatus == TrainStatus::TrainBArrival)
-    {
-        SetTrackPowerState(TrackPowerState::ReverseSlow);
-        return true;
-    }
+  uint8_t next = static_cast<uint8_t>(departure);
+  if (next >= TRAIN_STATUS_COUNT)
+  {
+    return;
+  }
 
-	// we want to enter the error state, not transition failure.
-	if (g_nextStatus >= TrainStatus::TrainErrorBase)
-	{
-		SetTrackPowerState(TrackPowerState::Stop);
-		return true;
-	}
+  uint8_t current = static_cast<uint8_t>(TrainStatus::BothInPlatform);
+  TransitionRule rule = pgm_read_byte(&s_transitions[current][next]);
+  uint8_t train = pgm_read_byte(&s_statusTrains[next].train);
+  PointsDirection points = static_cast<PointsDirection>((rule >> RULE_POINTS_SHIFT) & RULE_POINTS_MASK);
+  if (!(rule & RULE_ALLOWED) || points == PointsDirection::Invalid || train == NO_TRAIN)
+  {
+    return;
+  }
 
-    return false;
+  RequestRoute(train, pgm_read_byte(&s_statusTrains[next].block));
 }
 
-bool TransitionFromTrainBArrival()
+// Move to g_nextStatus. If the transition is waiting on the
+// points, stay in the current state; the next status is 
+// re-evaluated next loop (so sensors are still checked) and
+// the transition picks up the throw already in progress.
+TransitionResult TransitionState()
 {
-    if (g_nextStatus == TrainStatus::BothInPlatform)
+    if (g_currentStatus == g_nextStatus)
     {
-        SetTrackPowerState(TrackPowerState::Stop);
-        return true;
+        return TransitionResult::Complete;
     }
 
-	// we want to enter the error state, not transition failure.
-	if (g_nextStatus >= TrainStatus::TrainErrorBase)
-	{
-		SetTrackPowerState(TrackPowerState::Stop);
-		return true;
-	}
-
-    return false;
-}
-
-bool TransitionFromYPointFailure()
-{
-    return TransitionFromNoneOrError();
-}
-
-bool TransitionFromXPointFailure()
-{
-	return TransitionFromNoneOrError();
-}
+    TransitionResult result = ApplyTransitionRule();
 
-bool TransitionFromTrainMissing()
-{
-    return TransitionFromNoneOrError();
-}
+    if (result == TransitionResult::Pending)
+    {
+        return result;
+    }
 
-bool TransitionFromTransitionFailure()
-{
-	return TransitionFromNoneOrError();
-}
+    if (result == TransitionResult::Failed)
+    {
+        StopTrack();
+        ResetInterlocking();
+        LogEvent(LogEventId::TransitionFailed,
+                 static_cast<uint8_t>(g_currentStatus), static_cast<uint8_t>(g_nextStatus));
+        LogEvent(LogEventId::StateChange,
+                 static_cast<uint8_t>(g_currentStatus), static_cast<uint8_t>(TrainStatus::TransitionFailure));
+        StatsStatusChanged(g_currentStatus, TrainStatus::TransitionFailure);
+        g_previousStatus = g_currentStatus;
+        g_currentStatus = TrainStatus::TransitionFailure;
+        s_statusEnteredTime = HalMillis();
+        return result;
+    }
 
-bool _TransitionState()
-{
-    switch (g_currentStatus)
-    {
-        case TrainStatus::BothInPlatform:    return TransitionFromBothInPlatform();  
-        case TrainStatus::TrainADeparture:   return TransitionFromTrainADeparture();
-        case TrainStatus::TrainAOnLine:      return TransitionFromTrainAOnLine();    
-        case TrainStatus::TrainAArrival:     return TransitionFromTrainAArrival();   
-        case TrainStatus::TrainBDeparture:   return TransitionFromTrainBDeparture();
-        case TrainStatus::TrainBOnLine:      return TransitionFromTrainBOnLine();    
-        case TrainStatus::TrainBArrival:     return TransitionFromTrainBArrival();    
-        case TrainStatus::YPointFailure:     return TransitionFromYPointFailure();
-        case TrainStatus::XPointFailure:     return TransitionFromXPointFailure();
-        case TrainStatus::TrainMissing:      return TransitionFromTrainMissing();
-		case TrainStatus::TransitionFailure: return TransitionFromTransitionFailure();
-		case TrainStatus::None:              return TransitionFromNoneOrError();
-        default: 
-		{
-			DEBUG_PRINT("Unknown transition base"); 
-			DEBUG_PRINTLN(StateToString(g_currentStatus));
-			return false;
-		}
+    if (g_currentStatus == TrainStatus::BothInPlatform)
+    {
+        // We are leaving the platform, so reset departure time
+        g_departureTime = INVALID_DEPARTURE_TIME;
     }
-}
 
-bool TransitionState()
-{
-    if (g_currentStatus == g_nextStatus)
+    if (g_nextStatus > TrainStatus::TrainErrorBase)
     {
-        return;
+        // Stop everything without waiting for the ramp. Recovery
+        // works out from the sensors where the trains are and
+        // reserves from there.
+        StopTrack();
+        ResetInterlocking();
     }
 
-    if(!_TransitionState())
+    LogEvent(LogEventId::StateChange,
+             static_cast<uint8_t>(g_currentStatus), static_cast<uint8_t>(g_nextStatus));
+
+    StatsStatusChanged(g_currentStatus, g_nextStatus);
+
+    // Leaving None at start up keeps any previous status the
+    // journal restored, so the right train leaves next
+    if (g_currentStatus != TrainStatus::None)
     {
-        SetTrackPowerState(TrackPowerState::Stop);
         g_previousStatus = g_currentStatus;
-        g_currentStatus = TrainStatus::TransitionFailure;
-        return false;
     }
-
-    g_previousStatus = g_currentStatus;
     g_currentStatus = g_nextStatus;
+    s_statusEnteredTime = HalMillis();
 
-    return true;
+    return result;
 }
 
 const char* StateToString(TrainStatus status)
@@ -853,6 +804,7 @@ const char* StateToString(TrainStatus status)
         case TrainStatus::TrainMissing:      return "TrainMissing";
         case TrainStatus::InvalidState:      return "InvalidState";
         case TrainStatus::TransitionFailure: return "TransitionFailure";
+        case TrainStatus::Stopped:           return "Stopped";
         default:                             return "Unknown";            
     }
 }
\ No newline at end of file
@@ -1,17 +1,23 @@
 #pragma once
 
-#include <Arduino.h>
+#include "hal.h"
 
 #include "defines.h"
+#include "config.h"
 #include "enums.h"
+#include "interlocking.h"
 #include "point_control.h"
+#include "stats.h"
+#include "telemetry.h"
 #include "train_control.h"
 
 #define INVALID_DEPARTURE_TIME 0xFFFFFFFF
 
 TrainStatus GetCurrentTrainStatus();
 TrainStatus GetNextTrainStatus();
-bool TransitionState();
+TransitionResult TransitionState();
+void RequestStop(bool stop);
+bool StopRequested();
 
 const char* StateToString(TrainStatus status);
 
@@ -0,0 +1,210 @@
+#include "stats.h"
+
+#if defined(_STATS)
+
+// The states a train is running (or both dwelling) in, which get
+// a histogram each. The rest only get their total time.
+#define STATS_RUNNING_FIRST static_cast<uint8_t>(TrainStatus::BothInPlatform)
+#define STATS_RUNNING_COUNT (static_cast<uint8_t>(TrainStatus::TrainErrorBase) - STATS_RUNNING_FIRST)
+
+// Steps through the dump, one per record it might write
+#define STATS_DUMP_STATES    0
+#define STATS_DUMP_RESIDENCY (STATS_DUMP_STATES + TRAIN_STATUS_COUNT)
+#define STATS_DUMP_POINTS    (STATS_DUMP_RESIDENCY + STATS_RUNNING_COUNT * STATS_BUCKETS)
+#define STATS_DUMP_TRIPS     (STATS_DUMP_POINTS + LAYOUT_POINTS_COUNT * STATS_BUCKETS)
+#define STATS_DUMP_STEPS     (STATS_DUMP_TRIPS + LAYOUT_TRAIN_COUNT)
+
+struct StateStats
+{
+  uint16_t entries;
+  // In tenths of a second, which lasts 13 years
+  uint32_t tenths;
+};
+
+static StateStats s_states[TRAIN_STATUS_COUNT];
+static uint16_t s_residency[STATS_RUNNING_COUNT][STATS_BUCKETS];
+static uint16_t s_pointsLatency[LAYOUT_POINTS_COUNT][STATS_BUCKETS];
+static uint16_t s_roundTrips[LAYOUT_TRAIN_COUNT];
+
+// The state being timed and when it was entered
+static TrainStatus s_status = TrainStatus::None;
+static uint32_t s_enteredMillis = 0;
+
+static uint16_t s_dumpStep = STATS_DUMP_STEPS;
+static uint32_t s_lastDumpMillis = 0;
+
+static uint8_t Bucket(uint32_t millis, uint16_t unit)
+{
+  uint32_t units = millis / unit;
+  uint8_t bucket = 0;
+  while (units > 0 && bucket < STATS_BUCKETS - 1)
+  {
+    units >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+static void Count(uint16_t& count)
+{
+  if (count < 0xFFFF)
+  {
+    ++count;
+  }
+}
+
+static uint32_t Tenths(uint32_t millis)
+{
+  return (millis + 50) / 100;
+}
+
+// Call each time g_currentStatus changes
+void StatsStatusChanged(TrainStatus from, TrainStatus to)
+{
+  uint32_t now = HalMillis();
+  uint32_t elapsed = now - s_enteredMillis;
+  uint8_t index = static_cast<uint8_t>(from);
+
+  if (index < TRAIN_STATUS_COUNT)
+  {
+    s_states[index].tenths += Tenths(elapsed);
+
+    uint8_t running = index - STATS_RUNNING_FIRST;
+    if (running < STATS_RUNNING_COUNT)
+    {
+      Count(s_residency[running][Bucket(elapsed, STATS_RESIDENCY_UNIT)]);
+    }
+  }
+
+  if (to == TrainStatus::BothInPlatform)
+  {
+    if (from == TrainStatus::TrainAArrival)
+    {
+      Count(s_roundTrips[LAYOUT_TRAIN_A]);
+    }
+    else if (from == TrainStatus::TrainBArrival)
+    {
+      Count(s_roundTrips[LAYOUT_TRAIN_B]);
+    }
+  }
+
+  index = static_cast<uint8_t>(to);
+  if (index < TRAIN_STATUS_COUNT)
+  {
+    Count(s_states[index].entries);
+  }
+
+  s_status = to;
+  s_enteredMillis = now;
+}
+
+// Call when a throw of the points (LAYOUT_POINTS_*) confirms
+void StatsPointsThrown(uint8_t points, uint32_t millis)
+{
+  if (points < LAYOUT_POINTS_COUNT)
+  {
+    Count(s_pointsLatency[points][Bucket(millis, STATS_POINTS_UNIT)]);
+  }
+}
+
+// Write everything to the log, starting with the next run of
+// UpdateStats. Restarts a dump already in progress.
+void StartStatsDump()
+{
+  s_dumpStep = 0;
+  s_lastDumpMillis = HalMillis();
+}
+
+static void LogCount(LogEventId id, uint8_t first, uint8_t second, uint16_t count)
+{
+  uint8_t payload[] = {
+    first, second, static_cast<uint8_t>(count), static_cast<uint8_t>(count >> 8)
+  };
+  LogEvent(id, payload, sizeof(payload));
+}
+
+// Write the record for a step of the dump, if it has anything
+// to say. Returns true if it wrote one.
+static bool DumpStep(uint16_t step)
+{
+  if (step < STATS_DUMP_RESIDENCY)
+  {
+    uint8_t status = step - STATS_DUMP_STATES;
+    const StateStats& stats = s_states[status];
+    uint32_t tenths = stats.tenths;
+    if (static_cast<uint8_t>(s_status) == status)
+    {
+      // Include the visit so far
+      tenths += Tenths(HalMillis() - s_enteredMillis);
+    }
+    if (stats.entries == 0 && tenths == 0)
+    {
+      return false;
+    }
+
+    uint8_t payload[] = {
+      status,
+      static_cast<uint8_t>(stats.entries), static_cast<uint8_t>(stats.entries >> 8),
+      static_cast<uint8_t>(tenths), static_cast<uint8_t>(tenths >> 8),
+      static_cast<uint8_t>(tenths >> 16), static_cast<uint8_t>(tenths >> 24)
+    };
+    LogEvent(LogEventId::StatsState, payload, sizeof(payload));
+    return true;
+  }
+
+  if (step < STATS_DUMP_POINTS)
+  {
+    uint8_t running = (step - STATS_DUMP_RESIDENCY) / STATS_BUCKETS;
+    uint8_t bucket = (step - STATS_DUMP_RESIDENCY) % STATS_BUCKETS;
+    uint16_t count = s_residency[running][bucket];
+    if (count == 0)
+    {
+      return false;
+    }
+
+    LogCount(LogEventId::StatsResidency, STATS_RUNNING_FIRST + running, bucket, count);
+    return true;
+  }
+
+  if (step < STATS_DUMP_TRIPS)
+  {
+    uint8_t points = (step - STATS_DUMP_POINTS) / STATS_BUCKETS;
+    uint8_t bucket = (step - STATS_DUMP_POINTS) % STATS_BUCKETS;
+    uint16_t count = s_pointsLatency[points][bucket];
+    if (count == 0)
+    {
+      return false;
+    }
+
+    LogCount(LogEventId::StatsPointsLatency, points, bucket, count);
+    return true;
+  }
+
+  uint8_t train = step - STATS_DUMP_TRIPS;
+  uint8_t payload[] = {
+    train, static_cast<uint8_t>(s_roundTrips[train]), static_cast<uint8_t>(s_roundTrips[train] >> 8)
+  };
+  LogEvent(LogEventId::StatsRoundTrips, payload, sizeof(payload));
+  return true;
+}
+
+// Start a dump every STATS_DUMP_PERIOD and write the next
+// STATS_DUMP_BATCH records of one in progress
+void UpdateStats()
+{
+  if (s_dumpStep == STATS_DUMP_STEPS && HalMillis() - s_lastDumpMillis >= STATS_DUMP_PERIOD)
+  {
+    StartStatsDump();
+  }
+
+  uint8_t written = 0;
+  while (s_dumpStep < STATS_DUMP_STEPS && written < STATS_DUMP_BATCH)
+  {
+    if (DumpStep(s_dumpStep++))
+    {
+      ++written;
+    }
+  }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+#include "enums.h"
+#include "layout.h"
+#include "telemetry.h"
+
+// Running statistics of where the time goes, in fixed size
+// counters in RAM, to tell whether dwell, the points or slow
+// running limit how often the trains go round:
+// * For every state, how often it was entered and the total
+//   time spent in it, so errors show as time lost.
+// * For the running states, a histogram of how long each visit
+//   took, in buckets of STATS_RESIDENCY_UNIT ms doubling each time.
+// * For each set of points, a histogram of throw times from the
+//   control output changing to the feedback confirming, in
+//   buckets of STATS_POINTS_UNIT ms.
+// * Round trips for each train.
+// Counts stop at 0xFFFF rather than wrap. They are kept from start
+// up, and written to the log every STATS_DUMP_PERIOD, or when
+// StartStatsDump is called, a few records each run of the task.
+
+// Histograms count in units of 0, 1, 2-3, 4-7 ...
+// with the top bucket taking everything longer
+#define STATS_BUCKETS 12
+
+#if defined(_STATS)
+void StatsStatusChanged(TrainStatus from, TrainStatus to);
+void StatsPointsThrown(uint8_t points, uint32_t millis);
+void StartStatsDump();
+void UpdateStats();
+#else
+inline void StatsStatusChanged(TrainStatus, TrainStatus) {}
+inline void StatsPointsThrown(uint8_t, uint32_t) {}
+inline void StartStatsDump() {}
+inline void UpdateStats() {}
+#endif
\ No newline at end of file
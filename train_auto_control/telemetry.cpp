@@ -0,0 +1,156 @@
+#include "telemetry.h"
+
+#if defined(_TELEMETRY)
+
+#if (TELEMETRY_BUFFER_SIZE & (TELEMETRY_BUFFER_SIZE - 1)) != 0 || TELEMETRY_BUFFER_SIZE > 256
+#error TELEMETRY_BUFFER_SIZE must be a power of 2, no more than 256
+#endif
+
+#define TELEMETRY_INDEX_MASK (TELEMETRY_BUFFER_SIZE - 1)
+
+// Id, up to 5 bytes of varint time and the payload
+#define TELEMETRY_MAX_RECORD (1 + 5 + TELEMETRY_MAX_PAYLOAD)
+// COBS adds a byte per 254 plus the terminating 0
+#define TELEMETRY_MAX_FRAME (TELEMETRY_MAX_RECORD + 2)
+
+// Encoded frames waiting to be written. Only ever used from the
+// loop, so unlike the input events there's nothing to protect.
+static uint8_t s_buffer[TELEMETRY_BUFFER_SIZE];
+static uint8_t s_head = 0;
+static uint8_t s_tail = 0;
+
+static bool s_enabled = false;
+static uint32_t s_lastRecordMillis = 0;
+static uint16_t s_dropped = 0;
+
+static uint8_t BufferFree()
+{
+  return (s_tail - s_head - 1) & TELEMETRY_INDEX_MASK;
+}
+
+// COBS encode a record straight into the buffer. The caller
+// has already checked there's room for TELEMETRY_MAX_FRAME.
+static void QueueFrame(const uint8_t* record, uint8_t length)
+{
+  uint8_t codeIndex = s_head;
+  uint8_t code = 1;
+  s_head = (s_head + 1) & TELEMETRY_INDEX_MASK;
+
+  for (uint8_t i = 0; i < length; ++i)
+  {
+    if (record[i] == 0)
+    {
+      s_buffer[codeIndex] = code;
+      codeIndex = s_head;
+      code = 1;
+    }
+    else
+    {
+      s_buffer[s_head] = record[i];
+      ++code;
+    }
+    s_head = (s_head + 1) & TELEMETRY_INDEX_MASK;
+  }
+
+  s_buffer[codeIndex] = code;
+  s_buffer[s_head] = 0;
+  s_head = (s_head + 1) & TELEMETRY_INDEX_MASK;
+}
+
+// Build a record and queue it, returning false if there
+// wasn't room for it.
+static bool QueueRecord(LogEventId id, const uint8_t* payload, uint8_t length)
+{
+  if (BufferFree() < TELEMETRY_MAX_FRAME)
+  {
+    return false;
+  }
+
+  uint8_t record[TELEMETRY_MAX_RECORD];
+  uint8_t size = 0;
+  record[size++] = static_cast<uint8_t>(id);
+
+  uint32_t now = HalMillis();
+  uint32_t delta = now - s_lastRecordMillis;
+  s_lastRecordMillis = now;
+  while (delta >= 0x80)
+  {
+    record[size++] = static_cast<uint8_t>(delta) | 0x80;
+    delta >>= 7;
+  }
+  record[size++] = static_cast<uint8_t>(delta);
+
+  for (uint8_t i = 0; i < length; ++i)
+  {
+    record[size++] = payload[i];
+  }
+
+  QueueFrame(record, size);
+  return true;
+}
+
+// Start logging, with a Boot record so the reader knows
+// the times that follow are from a fresh start.
+void TelemetryBegin()
+{
+  s_head = 0;
+  s_tail = 0;
+  s_dropped = 0;
+  s_lastRecordMillis = 0;
+  s_enabled = true;
+  LogEvent(LogEventId::Boot, TELEMETRY_VERSION);
+}
+
+// Stop logging, for when something else needs the serial
+// port to itself. Anything still queued is discarded.
+void TelemetryEnd()
+{
+  s_enabled = false;
+  s_head = s_tail;
+}
+
+// Queue a record. Never blocks: if the buffer is full the record
+// is counted and reported in a Dropped record once there's room.
+void LogEvent(LogEventId id, const uint8_t* payload, uint8_t length)
+{
+  if (!s_enabled)
+  {
+    return;
+  }
+
+  if (length > TELEMETRY_MAX_PAYLOAD)
+  {
+    length = TELEMETRY_MAX_PAYLOAD;
+  }
+
+  if (s_dropped)
+  {
+    uint8_t dropped[] = { static_cast<uint8_t>(s_dropped), static_cast<uint8_t>(s_dropped >> 8) };
+    if (!QueueRecord(LogEventId::Dropped, dropped, sizeof(dropped)))
+    {
+      if (s_dropped < 0xFFFF) { ++s_dropped; }
+      return;
+    }
+    s_dropped = 0;
+  }
+
+  if (!QueueRecord(id, payload, length))
+  {
+    ++s_dropped;
+  }
+}
+
+// Write out as much of the queue as the serial port
+// will take without waiting. Call when the loop is idle.
+void TelemetryFlush()
+{
+  int space = Serial.availableForWrite();
+  while (space > 0 && s_tail != s_head)
+  {
+    Serial.write(s_buffer[s_tail]);
+    s_tail = (s_tail + 1) & TELEMETRY_INDEX_MASK;
+    --space;
+  }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+#include "enums.h"
+
+// Compact binary event log, so logging can stay on without
+// holding up the control loop. Each record is:
+//   event id, ms since the previous record (base 128 varint), payload
+// COBS encoded and ended with a 0 byte, so a reader can join the
+// stream anywhere. Records are queued in RAM and only written out
+// by TelemetryFlush, as much as the serial TX buffer takes without
+// blocking. If the queue fills, records are dropped and counted.
+// host/log_decode.cpp turns the stream back into text.
+
+// Sent in the Boot record, bump when the record format changes
+#define TELEMETRY_VERSION 3
+
+// Longest payload a record can carry
+#define TELEMETRY_MAX_PAYLOAD 7
+
+#if defined(_TELEMETRY)
+void TelemetryBegin();
+void TelemetryEnd();
+void TelemetryFlush();
+void LogEvent(LogEventId id, const uint8_t* payload, uint8_t length);
+#else
+inline void TelemetryBegin() {}
+inline void TelemetryEnd() {}
+inline void TelemetryFlush() {}
+inline void LogEvent(LogEventId, const uint8_t*, uint8_t) {}
+#endif
+
+inline void LogEvent(LogEventId id)
+{
+  LogEvent(id, nullptr, 0);
+}
+
+inline void LogEvent(LogEventId id, uint8_t value)
+{
+  LogEvent(id, &value, 1);
+}
+
+inline void LogEvent(LogEventId id, uint8_t first, uint8_t second)
+{
+  uint8_t payload[] = { first, second };
+  LogEvent(id, payload, sizeof(payload));
+}
+
+inline void LogEvent(LogEventId id, uint8_t first, uint8_t second, uint8_t third)
+{
+  uint8_t payload[] = { first, second, third };
+  LogEvent(id, payload, sizeof(payload));
+}
\ No newline at end of file
@@ -1,60 +1,171 @@
+#include "hal.h"
 #include "defines.h"
+#include "config.h"
 #include "enums.h"
+#include "inputs.h"
+#include "layout.h"
+#include "sensor_filter.h"
+#include "interlocking.h"
+#include "transit_timing.h"
+#include "input_events.h"
 #include "point_control.h"
 #include "state_control.h"
+#include "train_control.h"
 #include "error.h"
+#include "telemetry.h"
+#include "journal.h"
+#include "stats.h"
+#include "console.h"
+#include "scheduler.h"
+#include "benchmark.h"
 
 #include <stdint.h>
 
-void HandleNextState()
+// Work out the next state from g_inputs and move to it
+static void StepStateMachine()
 {
-  DEBUG_PRINT("Previous: "); DEBUG_PRINTLN(StateToString(g_previousStatus));
-  DEBUG_PRINT("Current:  "); DEBUG_PRINTLN(StateToString(g_currentStatus));
+  UpdateOccupancy();
+
+  // Points move in the background, so bring them
+  // up to date before deciding anything
+  PollPoints();
+  UpdateInterlocking();
+
   g_nextStatus = GetNextTrainStatus();
-  DEBUG_PRINT("Next:     "); DEBUG_PRINTLN(StateToString(g_nextStatus));
   TransitionState();
 
+  // Braking the model has put off until later
+  UpdateTransitTiming();
+}
+
+// Move g_inputsMicros on to micros, but never back, as
+// everything timed from it takes differences which would
+// wrap. An edge caught just after HandleTimedState took
+// its time is counted as seen then.
+static void AdvanceInputsMicros(uint32_t micros)
+{
+  if (static_cast<int32_t>(micros - g_inputsMicros) > 0)
+  {
+    g_inputsMicros = micros;
+  }
+}
+
+// Step through every input edge captured since the
+// last run in order, so a sensor pulse shorter than
+// the task period still moves the state machine on
+static void HandleInputEdges()
+{
+  InputEvent event;
+  while (NextInputEvent(event))
+  {
+    g_inputs = event.inputs;
+    AdvanceInputsMicros(event.micros);
+    StepStateMachine();
+  }
+}
+
+// The parts which move on with time rather than
+// edges (dwell, point throws, retries). Edges still
+// queued are handled first, so they aren't seen after
+// a later time.
+static void HandleTimedState()
+{
+  HandleInputEdges();
+  AdvanceInputsMicros(HalMicros());
+  StepStateMachine();
+
   WriteError();
+}
+
+static void LogTaskStatsTask();
 
-  //DEBUG_DELAY(1000);
+// Everything loop() does, most urgent first.
+// Rates are set in defines.h. The zeros are the
+// scheduler's own fields, set by StartScheduler.
+Task g_tasks[] = {
+  { "Inputs",    HandleInputEdges,  INPUT_TASK_PERIOD,     0, 0, 0, 0, 0 },
+  { "State",     HandleTimedState,  STATE_TASK_PERIOD,     0, 0, 0, 0, 0 },
+  { "Speed",     UpdateTrackSpeed,  SPEED_TASK_PERIOD,     0, 0, 0, 0, 0 },
+  { "Telemetry", TelemetryFlush,    TELEMETRY_TASK_PERIOD, 0, 0, 0, 0, 0 },
+  { "Console",   UpdateConsole,     CONSOLE_TASK_PERIOD,   0, 0, 0, 0, 0 },
+  { "Journal",   UpdateJournal,     JOURNAL_TASK_PERIOD,   0, 0, 0, 0, 0 },
+  { "Config",    UpdateConfig,      CONFIG_TASK_PERIOD,    0, 0, 0, 0, 0 },
+  { "Stats",     UpdateStats,       STATS_TASK_PERIOD,     0, 0, 0, 0, 0 },
+  { "TaskStats", LogTaskStatsTask,  TASK_STATS_PERIOD,     0, 0, 0, 0, 0 }
+};
+uint8_t g_taskCount = sizeof(g_tasks) / sizeof(g_tasks[0]);
+
+static void LogTaskStatsTask()
+{
+  LogTaskStats(g_tasks, g_taskCount);
+}
+
+// One pass of every task regardless of its rate,
+// for start up and the benchmarks
+void HandleNextState()
+{
+  HandleInputEdges();
+  HandleTimedState();
+  UpdateTrackSpeed();
+  TelemetryFlush();
 }
 
 void setup() {
   // put your setup code here, to run once:
+  // Everything after reads the settings, so they come first
+  uint8_t configFlags = LoadConfig();
+  SetupLayout();
+  SetupSensorFilters();
+  SetupTransitTiming();
+  SetupInterlocking();
+
   for (int i = 0; i < INPUT_COUNT; ++i)
   {
-    pinMode(input_pins[i], INPUT_PULLUP);
+    HalPinMode(input_pins[i], INPUT_PULLUP);
   }
+  SetupInputSnapshot();
 
   for (int i = 0; i < OUTPUT_COUNT; ++i)
   {
-    pinMode(output_pins[i], OUTPUT);
-    digitalWrite(output_pins[i], !TRACK_POWER);
+    HalPinMode(output_pins[i], OUTPUT);
+    HalDigitalWrite(output_pins[i], !g_config.trackPower);
   }
 
   // If track power is changed to be active high
   // this will stop the train before it's had time
   // to really move.
-  SetTrackPowerState(TrackPowerState::Stop);
+  StopTrack();
 
   for (int i = 0; i < ERROR_CODE_BITS; ++i)
   {
-    pinMode(ERROR_CODE_BASE + i, OUTPUT);
-    digitalWrite(ERROR_CODE_BASE + i, LOW);
+    HalPinMode(ERROR_CODE_BASE + i, OUTPUT);
+    HalDigitalWrite(ERROR_CODE_BASE + i, LOW);
   }
 
-  // Enables serial if _DEBUG is defined or _SERIAL is defined
+  // Enables serial if _TELEMETRY or _BENCHMARK is defined
   SERIAL_BEGIN(9600);
+  TelemetryBegin();
+  LogEvent(LogEventId::ConfigLoaded, configFlags);
+
+#if defined(_BENCHMARK)
+  RunBenchmarks();
+  while (true) {}
+#endif
 
-  // 7s delay to allow for startup of IR detectors
-  delay(7000);
+  // Give the IR detectors time to start up, then start
+  // capturing edges from where they've settled
+  WaitForStableInputs();
+  SetupInputEvents();
 
   g_previousStatus = TrainStatus::None;
   g_currentStatus  = TrainStatus::None;
+  RestoreJournal();
   HandleNextState();
+
+  StartScheduler(g_tasks, g_taskCount);
 }
 
 void loop() {
   // put your main code here, to run repeatedly:
-  HandleNextState();
-}
+  RunScheduler(g_tasks, g_taskCount);
+}
\ No newline at end of file
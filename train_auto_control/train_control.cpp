@@ -1,98 +1,250 @@
 #include "train_control.h"
 
-// Set the TRACK_DIRECTION_PIN to FORWARD
-// Change the define for FORWARD to control
+// Where each district's speed is and where it's heading
+struct DistrictSpeed
+{
+  TrackSpeed current;
+  TrackSpeed target;
+};
+
+static DistrictSpeed s_districtSpeeds[LAYOUT_DISTRICT_COUNT];
+
+// The districts' direction, fast and (without _TRACK_PWM) power
+// outputs. The Set* functions below stage their levels here, and
+// WriteDistrictSpeed commits them all in one write per port, so
+// the power stage never sees them half changed.
+static HalOutputShadow s_outputs;
+
+// Set the district's direction pin to g_config.forward
+// Change it (FORWARD by default) to control
 // whether HIGH or LOW mean forward
-static void SetTrackDirectionForward()
+static void SetTrackDirectionForward(const DistrictDef& district)
 {
-    digitalWrite(TRACK_DIRECTION_PIN, FORWARD);
+    s_outputs.Set(district.direction, g_config.forward);
 }
 
 
-// Set the TRACK_DIRECTION_PIN to !FORWARD
-// Change the define for FORWARD to control
+// Set the district's direction pin to !g_config.forward
+// Change it (FORWARD by default) to control
 // whether HIGH or LOW mean reverse
-static void SetTrackDirectionReverse()
+static void SetTrackDirectionReverse(const DistrictDef& district)
 {
-    digitalWrite(TRACK_DIRECTION_PIN, !FORWARD);
+    s_outputs.Set(district.direction, !g_config.forward);
 }
 
-// Set the TRACK_POWER_PIN to TRACK_POWER
-// Change the define for TRACK_POWER to control
-// whether HIGH or LOW mean enable track power
-static void SetTrackPowerOn()
+// Set the district's power pin to g_config.trackPower, for
+// the given fraction (out of TRACK_SPEED_MAX) of the
+// time with _TRACK_PWM. Change it (TRACK_POWER by default)
+// to control whether HIGH or LOW mean enable track power.
+// With _TRACK_PWM the duty is set straight away, rather
+// than staged, so call it once the rest are committed.
+static void SetTrackPowerOn(const DistrictDef& district, uint8_t duty)
 {
-    digitalWrite(TRACK_POWER_PIN, TRACK_POWER);
+#if defined(_TRACK_PWM)
+    HalPwmWrite(district.power.number, g_config.trackPower ? duty : TRACK_SPEED_MAX - duty);
+#else
+    (void)duty;
+    s_outputs.Set(district.power, g_config.trackPower);
+#endif
 }
 
-// Set the TRACK_POWER_PIN to !TRACK_POWER
-// Change the define for TRACK_POWER to control
+// Set the district's power pin to !g_config.trackPower
+// Change it (TRACK_POWER by default) to control
 // whether HIGH or LOW mean disable track power
-static void SetTrackPowerOff()
+static void SetTrackPowerOff(const DistrictDef& district)
 {
-    digitalWrite(TRACK_POWER_PIN, !TRACK_POWER);
+#if defined(_TRACK_PWM)
+    HalPwmWrite(district.power.number, g_config.trackPower ? 0 : TRACK_SPEED_MAX);
+#else
+    s_outputs.Set(district.power, !g_config.trackPower);
+#endif
 }
 
-// Set the TRACK_FAST pin to TRACK_FAST
-// Change the define for TRACK_FAST to control
+// Set the district's fast pin to g_config.trackFast
+// Change it (TRACK_FAST by default) to control
 // whether HIGH or LOW mean set the track to fast
-static void SetTrackFast()
+static void SetTrackFast(const DistrictDef& district)
 {
-    digitalWrite(TRACK_FAST_PIN, TRACK_FAST);
+    s_outputs.Set(district.fast, g_config.trackFast);
 }
 
-// Set the TRACK_FAST pin to !TRACK_FAST
-// Change the define for TRACK_FAST to control
+#if !defined(_TRACK_PWM)
+// Set the district's fast pin to !g_config.trackFast
+// Change it (TRACK_FAST by default) to control
 // whether HIGH or LOW mean set the track to slow
-static void SetTrackSlow()
+static void SetTrackSlow(const DistrictDef& district)
 {
-    digitalWrite(TRACK_FAST_PIN, !TRACK_FAST);
+    s_outputs.Set(district.fast, !g_config.trackFast);
 }
+#endif
 
-// Apply the relevant inputs to align with the desired
-// track power state. This should be the only visible function
-// for other parts of the code
-void SetTrackPowerState(TrackPowerState nextTrackPowerState)
+// Apply a speed to the outputs of one power district
+static void WriteDistrictSpeed(uint8_t districtIndex, TrackSpeed speed)
 {
-    switch(nextTrackPowerState)
+    const DistrictDef& district = s_layoutDistricts[districtIndex];
+
+    if (speed == 0)
     {
-        case TrackPowerState::Stop:
-        {
-            SetTrackPowerOff();
-            break;
-        }
-        case TrackPowerState::ForwardSlow:
-        {
-            SetTrackDirectionForward();
-            SetTrackSlow();
-            SetTrackPowerOn();
-            break;
-        }
-        case TrackPowerState::ForwardFast:
+        SetTrackPowerOff(district);
+        s_outputs.Commit();
+        return;
+    }
+
+    if (speed > 0)
+    {
+        SetTrackDirectionForward(district);
+    }
+    else
+    {
+        SetTrackDirectionReverse(district);
+        speed = -speed;
+    }
+
+#if defined(_TRACK_PWM)
+    SetTrackFast(district);
+#else
+    if (speed > TRACK_SPEED_SLOW)
+    {
+        SetTrackFast(district);
+    }
+    else
+    {
+        SetTrackSlow(district);
+    }
+#endif
+
+#if defined(_TRACK_PWM)
+    // Direction and fast are in place before the power comes on
+    s_outputs.Commit();
+    SetTrackPowerOn(district, speed);
+#else
+    SetTrackPowerOn(district, speed);
+    s_outputs.Commit();
+#endif
+}
+
+// One ramp step from the current speed towards the target.
+// Changing direction means slowing to a stop first.
+static TrackSpeed RampTowards(TrackSpeed current, TrackSpeed target)
+{
+    bool reverse = current < 0 || (current == 0 && target < 0);
+    int16_t magnitude = reverse ? -current : current;
+    int16_t targetMagnitude = reverse ? -target : target;
+
+    if (targetMagnitude < 0)
+    {
+        targetMagnitude = 0;
+    }
+
+    if (targetMagnitude > magnitude)
+    {
+        magnitude += TRACK_ACCELERATION;
+        if (magnitude > targetMagnitude)
         {
-            SetTrackDirectionForward();
-            SetTrackFast();
-            SetTrackPowerOn();
-            break;
+            magnitude = targetMagnitude;
         }
-        case TrackPowerState::ReverseSlow:
+    }
+    else
+    {
+        magnitude -= TRACK_DECELERATION;
+        if (magnitude < targetMagnitude)
         {
-            SetTrackDirectionReverse();
-            SetTrackSlow();
-            SetTrackPowerOn();
-            break;
+            magnitude = targetMagnitude;
         }
-        case TrackPowerState::ReverseFast:
+    }
+
+    return reverse ? -magnitude : magnitude;
+}
+
+// The speed for each of the state machine's track power states
+TrackSpeed TrackPowerSpeed(TrackPowerState state)
+{
+    switch(state)
+    {
+        case TrackPowerState::Stop:        return 0;
+        case TrackPowerState::ForwardSlow: return TRACK_SPEED_SLOW;
+        case TrackPowerState::ForwardFast: return TRACK_SPEED_FAST;
+        case TrackPowerState::ReverseSlow: return -TRACK_SPEED_SLOW;
+        case TrackPowerState::ReverseFast: return -TRACK_SPEED_FAST;
+        default:
         {
-            SetTrackDirectionReverse();
-            SetTrackFast();
-            SetTrackPowerOn();
-            break;
+            LogEvent(LogEventId::TrackPowerInvalid, static_cast<uint8_t>(state));
+            return 0;
         }
-        default:
+    }
+}
+
+// Set the speed one power district (LAYOUT_DISTRICT_*) ramps
+// to: positive is forward (train A's direction), negative
+// reverse. UpdateTrackSpeed moves the outputs towards it
+// with _TRACK_PWM; without, they're set straight away.
+void SetDistrictPowerState(uint8_t districtIndex, TrackSpeed targetSpeed)
+{
+    LogEvent(LogEventId::TrackPower, districtIndex,
+             static_cast<uint8_t>(targetSpeed), static_cast<uint8_t>(targetSpeed >> 8));
+
+    s_districtSpeeds[districtIndex].target = targetSpeed;
+
+#if !defined(_TRACK_PWM)
+    // On/off outputs can't be ramped, and ramping them only
+    // holds the old speed for longer, so change straight away
+    s_districtSpeeds[districtIndex].current = targetSpeed;
+    WriteDistrictSpeed(districtIndex, targetSpeed);
+#endif
+}
+
+// Set every district to ramp to the same speed
+void SetTrackPowerState(TrackSpeed targetSpeed)
+{
+    for (uint8_t district = 0; district < LAYOUT_DISTRICT_COUNT; ++district)
+    {
+        SetDistrictPowerState(district, targetSpeed);
+    }
+}
+
+// Cut a district's power straight away, without the ramp
+void StopDistrict(uint8_t districtIndex)
+{
+    SetDistrictPowerState(districtIndex, 0);
+    s_districtSpeeds[districtIndex].current = 0;
+    WriteDistrictSpeed(districtIndex, 0);
+}
+
+// Cut all track power straight away, e.g. for an error
+void StopTrack()
+{
+    for (uint8_t district = 0; district < LAYOUT_DISTRICT_COUNT; ++district)
+    {
+        StopDistrict(district);
+    }
+}
+
+// Move each district one ramp step towards its target speed.
+// Run every SPEED_TASK_PERIOD, which the ramp rates assume.
+void UpdateTrackSpeed()
+{
+    for (uint8_t district = 0; district < LAYOUT_DISTRICT_COUNT; ++district)
+    {
+        DistrictSpeed& speed = s_districtSpeeds[district];
+        if (speed.current == speed.target)
         {
-            DEBUG_PRINTLN("Invalid power state!");
-            SetTrackPowerOff();
+            continue;
         }
+
+        speed.current = RampTowards(speed.current, speed.target);
+        WriteDistrictSpeed(district, speed.current);
     }
+}
+
+// The speed a district's outputs are set to, part way
+// through a ramp if it's changing
+TrackSpeed GetDistrictSpeed(uint8_t districtIndex)
+{
+    return s_districtSpeeds[districtIndex].current;
+}
+
+// The speed a district is ramping towards
+TrackSpeed GetDistrictTargetSpeed(uint8_t districtIndex)
+{
+    return s_districtSpeeds[districtIndex].target;
 }
\ No newline at end of file
@@ -1,8 +1,22 @@
 #pragma once
 
-#include <Arduino.h>
+#include "hal.h"
 
 #include "defines.h"
+#include "config.h"
 #include "enums.h"
+#include "layout.h"
+#include "telemetry.h"
 
-void SetTrackPowerState(TrackPowerState nextTrackPowerState);
\ No newline at end of file
+// Signed track speed: positive is forward (train A's direction),
+// negative reverse, up to TRACK_SPEED_MAX either way
+typedef int16_t TrackSpeed;
+
+TrackSpeed TrackPowerSpeed(TrackPowerState state);
+void SetDistrictPowerState(uint8_t districtIndex, TrackSpeed targetSpeed);
+void SetTrackPowerState(TrackSpeed targetSpeed);
+void StopDistrict(uint8_t districtIndex);
+void StopTrack();
+void UpdateTrackSpeed();
+TrackSpeed GetDistrictSpeed(uint8_t districtIndex);
+TrackSpeed GetDistrictTargetSpeed(uint8_t districtIndex);
\ No newline at end of file
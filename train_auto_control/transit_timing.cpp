@@ -0,0 +1,350 @@
+#include "transit_timing.h"
+#include "interlocking.h"
+
+#include <string.h>
+
+// Transit times are kept in units of this many ms,
+// so a block can take up to about four minutes
+#define TRANSIT_TIME_UNIT 4
+#define TRANSIT_TIME_UNKNOWN 0
+
+#define TRANSIT_SLOW 0
+#define TRANSIT_FAST 1
+// Logged for a block which the train braked part way through
+#define TRANSIT_BRAKED 2
+
+#define NO_BLOCK 0xFF
+
+// How long the decelerating from fast to slow takes, in ms.
+// Without _TRACK_PWM the outputs change straight away, so
+// there's no ramp.
+#if defined(_TRACK_PWM)
+#define BRAKE_RAMP_MILLIS \
+  ((TRACK_SPEED_FAST - TRACK_SPEED_SLOW + TRACK_DECELERATION - 1) / TRACK_DECELERATION * \
+   (SPEED_TASK_PERIOD / 1000))
+#else
+#define BRAKE_RAMP_MILLIS 0
+#endif
+
+// Moving averages in TRANSIT_TIME_UNITs, by [train][block][TRANSIT_SLOW or TRANSIT_FAST]
+static uint16_t s_transitTimes[LAYOUT_TRAIN_COUNT][LAYOUT_BLOCK_COUNT][2];
+
+// What each train is doing in the block it's in now. Timing starts
+// as it enters the block, and again each time the state machine
+// sets its power, so a block is always timed over the same stretch
+// whatever speed the train is running at.
+struct TrainTiming
+{
+  BlockIndex block;
+  uint32_t startMicros;
+  // Power when timing started, and now
+  TrackPowerState startPower;
+  TrackPowerState power;
+  // False while stopped, as there's nothing to time
+  bool valid;
+  // Braking put off until brakeMillis after timing started
+  bool brakePending;
+  bool braked;
+  uint32_t brakeMillis;
+  TrackPowerState brakePower;
+};
+
+static TrainTiming s_timing[LAYOUT_TRAIN_COUNT];
+
+// Trains still to run their calibration lap, one bit each
+static uint8_t s_calibrationLaps = 0;
+
+static bool IsFast(TrackPowerState power)
+{
+  return power == TrackPowerState::ForwardFast || power == TrackPowerState::ReverseFast;
+}
+
+static bool IsSlow(TrackPowerState power)
+{
+  return power == TrackPowerState::ForwardSlow || power == TrackPowerState::ReverseSlow;
+}
+
+static TrackPowerState SlowerPower(TrackPowerState power)
+{
+  switch (power)
+  {
+    case TrackPowerState::ForwardFast: return TrackPowerState::ForwardSlow;
+    case TrackPowerState::ReverseFast: return TrackPowerState::ReverseSlow;
+    default:                           return power;
+  }
+}
+
+static uint32_t TransitMillis(uint8_t train, BlockIndex block, uint8_t speed)
+{
+  return static_cast<uint32_t>(s_transitTimes[train][block][speed]) * TRANSIT_TIME_UNIT;
+}
+
+// Fold a new time into the moving average. The first
+// time for a block is taken as it is.
+static void AddTransitTime(uint8_t train, BlockIndex block, uint8_t speed, uint32_t millis)
+{
+  uint32_t units = millis / TRANSIT_TIME_UNIT;
+  if (units == TRANSIT_TIME_UNKNOWN || units > 0xFFFF)
+  {
+    return;
+  }
+
+  uint16_t& average = s_transitTimes[train][block][speed];
+  if (average == TRANSIT_TIME_UNKNOWN)
+  {
+    average = units;
+  }
+  else
+  {
+    int32_t difference = static_cast<int32_t>(units) - average;
+    average += difference / (1 << TRANSIT_AVERAGE_SHIFT);
+  }
+}
+
+// The train's fast speed time over its slow speed time, out of
+// 256, from the block it has been timed over longest at both.
+// 0 if there isn't one.
+static uint16_t SpeedRatio(uint8_t train)
+{
+  uint16_t longest = 0;
+  uint16_t ratio = 0;
+  for (BlockIndex block = 0; block < LAYOUT_BLOCK_COUNT; ++block)
+  {
+    uint16_t slow = s_transitTimes[train][block][TRANSIT_SLOW];
+    uint16_t fast = s_transitTimes[train][block][TRANSIT_FAST];
+    if (slow > longest && fast != TRANSIT_TIME_UNKNOWN && fast < slow)
+    {
+      longest = slow;
+      ratio = static_cast<uint32_t>(fast) * 256 / slow;
+    }
+  }
+  return ratio;
+}
+
+// Time the braking takes, as time at fast speed covering
+// the same distance. The average of the two speeds.
+static uint32_t BrakeFastMillis(uint16_t ratio)
+{
+  return static_cast<uint32_t>(BRAKE_RAMP_MILLIS) * (256 + ratio) / 512;
+}
+
+// How long the train would take over the block at fast speed
+// throughout: timed, or else worked out from the slow time.
+// 0 if it can't be known.
+static uint32_t PredictFastMillis(uint8_t train, BlockIndex block, uint16_t ratio)
+{
+  uint32_t fast = TransitMillis(train, block, TRANSIT_FAST);
+  if (fast != 0)
+  {
+    return fast;
+  }
+  return TransitMillis(train, block, TRANSIT_SLOW) * ratio / 256;
+}
+
+// Time a block the train braked part way through, as the time it
+// would have taken at fast speed throughout, to learn from it
+static void AddBrakedTime(uint8_t train, const TrainTiming& timing, uint32_t millis, uint16_t ratio)
+{
+  uint32_t after = millis > timing.brakeMillis ? millis - timing.brakeMillis : 0;
+  uint32_t fast;
+  if (after <= BRAKE_RAMP_MILLIS)
+  {
+    // Still braking when it got there
+    fast = timing.brakeMillis + after * (256 + ratio) / 512;
+  }
+  else
+  {
+    fast = timing.brakeMillis + BrakeFastMillis(ratio) + (after - BRAKE_RAMP_MILLIS) * ratio / 256;
+  }
+  AddTransitTime(train, timing.block, TRANSIT_FAST, fast);
+}
+
+// Learn from the time through the block just left
+static void RecordTransit(uint8_t train, const TrainTiming& timing, uint32_t millis)
+{
+  uint8_t kind;
+  if (timing.braked)
+  {
+    uint16_t ratio = SpeedRatio(train);
+    if (ratio == 0)
+    {
+      return;
+    }
+    AddBrakedTime(train, timing, millis, ratio);
+    kind = TRANSIT_BRAKED;
+  }
+  else if (IsFast(timing.startPower))
+  {
+    AddTransitTime(train, timing.block, TRANSIT_FAST, millis);
+    kind = TRANSIT_FAST;
+  }
+  else if (IsSlow(timing.startPower))
+  {
+    AddTransitTime(train, timing.block, TRANSIT_SLOW, millis);
+    kind = TRANSIT_SLOW;
+  }
+  else
+  {
+    return;
+  }
+
+  uint16_t logged = millis > 0xFFFF ? 0xFFFF : millis;
+  uint8_t payload[] = {
+    train, timing.block, kind,
+    static_cast<uint8_t>(logged), static_cast<uint8_t>(logged >> 8)
+  };
+  LogEvent(LogEventId::TransitTime, payload, sizeof(payload));
+}
+
+void SetupTransitTiming()
+{
+  for (uint8_t train = 0; train < LAYOUT_TRAIN_COUNT; ++train)
+  {
+    s_timing[train].block = NO_BLOCK;
+    s_timing[train].power = TrackPowerState::Stop;
+    s_timing[train].valid = false;
+    s_timing[train].brakePending = false;
+  }
+
+#if defined(_CALIBRATION_LAP)
+  s_calibrationLaps = (1 << LAYOUT_TRAIN_COUNT) - 1;
+#endif
+}
+
+void SaveTransitTiming(TransitTimingState& state)
+{
+  memcpy(state.transitTimes, s_transitTimes, sizeof(s_transitTimes));
+  state.calibrationLaps = s_calibrationLaps;
+}
+
+// Carry on from times learned before a restart, without
+// running the calibration lap again if it was done then
+void RestoreTransitTiming(const TransitTimingState& state)
+{
+  memcpy(s_transitTimes, state.transitTimes, sizeof(s_transitTimes));
+  s_calibrationLaps &= state.calibrationLaps;
+}
+
+// Called by the interlocking as a train's front reaches the
+// next block of its route, at g_inputsMicros
+void TrainEnteredBlock(uint8_t train, BlockIndex block)
+{
+  TrainTiming& timing = s_timing[train];
+
+  if (timing.block != NO_BLOCK && timing.valid)
+  {
+    RecordTransit(train, timing, (g_inputsMicros - timing.startMicros) / 1000);
+  }
+
+  timing.block = block;
+  timing.startMicros = g_inputsMicros;
+  timing.startPower = timing.power;
+  timing.valid = timing.power != TrackPowerState::Stop;
+  timing.braked = false;
+  timing.brakePending = false;
+
+  if ((s_calibrationLaps & (1 << train)) && block == TrainRoute(train).blocks[0])
+  {
+    s_calibrationLaps &= ~(1 << train);
+    if (s_calibrationLaps == 0)
+    {
+      LogEvent(LogEventId::CalibrationDone);
+    }
+  }
+}
+
+// Called by the interlocking whenever a train's power is set.
+// Restarts the timing, and a change of power cancels any
+// braking still to come.
+void TrainPowerChanged(uint8_t train, TrackPowerState power)
+{
+  TrainTiming& timing = s_timing[train];
+  if (timing.braked && power == timing.power)
+  {
+    // The planned braking itself, see UpdateTransitTiming
+    return;
+  }
+
+  if (power != timing.power)
+  {
+    timing.brakePending = false;
+  }
+
+  timing.power = power;
+  timing.startMicros = g_inputsMicros;
+  timing.startPower = power;
+  timing.valid = power != TrackPowerState::Stop;
+  timing.braked = false;
+}
+
+// The power to give a train for a change of status. While
+// calibrating that's never fast. Slowing down from fast is put
+// off for as long as the model says is safe, for
+// UpdateTransitTiming to apply.
+TrackPowerState PlanTrainPower(uint8_t train, TrackPowerState power)
+{
+  if (s_calibrationLaps & (1 << train))
+  {
+    return SlowerPower(power);
+  }
+
+  TrainTiming& timing = s_timing[train];
+  if (!IsSlow(power) || !IsFast(timing.power) || timing.block == NO_BLOCK)
+  {
+    return power;
+  }
+
+  uint16_t ratio = SpeedRatio(train);
+  uint32_t fast = PredictFastMillis(train, timing.block, ratio);
+  if (ratio == 0 || fast == 0)
+  {
+    return power;
+  }
+
+  uint32_t runMillis = fast * (100 - TRANSIT_BRAKE_MARGIN) / 100;
+  uint32_t brakeMillis = BrakeFastMillis(ratio);
+  if (runMillis <= brakeMillis)
+  {
+    return power;
+  }
+
+  timing.brakeMillis = runMillis - brakeMillis;
+  timing.brakePower = power;
+  timing.brakePending = true;
+
+  uint16_t logged = timing.brakeMillis > 0xFFFF ? 0xFFFF : timing.brakeMillis;
+  uint8_t payload[] = {
+    train, timing.block, static_cast<uint8_t>(logged), static_cast<uint8_t>(logged >> 8)
+  };
+  LogEvent(LogEventId::BrakePlanned, payload, sizeof(payload));
+
+  return timing.power;
+}
+
+// Start any braking which is due. Call each time the state
+// machine steps, after TransitionState.
+void UpdateTransitTiming()
+{
+  for (uint8_t train = 0; train < LAYOUT_TRAIN_COUNT; ++train)
+  {
+    TrainTiming& timing = s_timing[train];
+    if (!timing.brakePending ||
+        (g_inputsMicros - timing.startMicros) / 1000 < timing.brakeMillis)
+    {
+      continue;
+    }
+
+    // Learn from when it really braked, a step later at most
+    timing.brakePending = false;
+    timing.braked = true;
+    timing.brakeMillis = (g_inputsMicros - timing.startMicros) / 1000;
+    timing.power = timing.brakePower;
+    SetTrainPower(train, timing.brakePower);
+  }
+}
+
+// True until every train has run its calibration lap
+bool CalibrationRunning()
+{
+  return s_calibrationLaps != 0;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "hal.h"
+
+#include "defines.h"
+#include "enums.h"
+#include "inputs.h"
+#include "layout.h"
+#include "telemetry.h"
+
+// Learned transit times and predictive braking. Times how long each
+// train takes from entering each block to entering the next, kept as
+// a moving average for fast and slow running separately. From those
+// it predicts when a train slowing for a block can be left at fast
+// speed and still be down to slow with TRANSIT_BRAKE_MARGIN of the
+// block to go, so it spends less of the block crawling.
+//
+// Predicting needs the ratio of the train's speeds, from a block it
+// has run at both. Normally no block is, so with _CALIBRATION_LAP
+// each train first runs one lap all at slow speed.
+
+// What has been learned, kept over a restart by the journal
+struct TransitTimingState
+{
+  uint16_t transitTimes[LAYOUT_TRAIN_COUNT][LAYOUT_BLOCK_COUNT][2];
+  uint8_t calibrationLaps;
+};
+
+void SetupTransitTiming();
+void SaveTransitTiming(TransitTimingState& state);
+void RestoreTransitTiming(const TransitTimingState& state);
+void TrainEnteredBlock(uint8_t train, BlockIndex block);
+void TrainPowerChanged(uint8_t train, TrackPowerState power);
+TrackPowerState PlanTrainPower(uint8_t train, TrackPowerState power);
+void UpdateTransitTiming();
+bool CalibrationRunning();
\ No newline at end of file